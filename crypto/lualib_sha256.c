@@ -1,28 +1,86 @@
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
+// HMAC clones SHA256_CTX states, which the deprecated low-level API
+// allows with a plain copy; EVP_MD_CTX_copy_ex allocates on every copy
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/crypto.h>
 #include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA256_SIMD_X86
+#endif
 
 #define CRYPTO_SHA256_METATABLE "crypto.sha256"
+#define CRYPTO_SHA256_CONTEXT_METATABLE "crypto.sha256.context"
+#define CRYPTO_SHA256_HMAC_METATABLE "crypto.sha256.hmac"
 
-static int l_crypto_sha256_new(lua_State *L) {
-  EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-  if (ctx == NULL) {
+#define SHA256_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+// most messages a batch kernel hashes side by side
+#define SHA256_MAX_LANES 16
+// longer messages in a batch go through EVP; in a lane they would keep
+// running long after the other lanes ran dry
+#define SHA256_BATCH_MAX_LEN 1024
+
+// fetched once; passing EVP_sha256() to every init makes OpenSSL 3 look
+// the implementation up again each time
+static const EVP_MD *sha256_md;
+
+// a full userdata owning its context, so hashers get their own metatable
+// and __gc; EVP_MD_CTX is opaque and cannot be embedded
+struct sha256_hasher {
+  EVP_MD_CTX *ctx;
+  EVP_MD_CTX *scratch; // Sum finalizes a copy here, allocated on first use
+};
+
+static struct sha256_hasher *new_hasher(lua_State *L, const char *metatable) {
+  struct sha256_hasher *h = lua_newuserdata(L, sizeof(struct sha256_hasher));
+  h->ctx = NULL;
+  h->scratch = NULL;
+  luaL_getmetatable(L, metatable);
+  lua_setmetatable(L, -2);
+  h->ctx = EVP_MD_CTX_new();
+  if (h->ctx == NULL) {
     luaL_error(L, "failed to allocate EVP_MD_CTX");
-    return 0;
   }
-  EVP_DigestInit(ctx, EVP_sha256());
-  lua_pushlightuserdata(L, ctx);
-  luaL_getmetatable(L, CRYPTO_SHA256_METATABLE);
-  lua_setmetatable(L, -2);
+  return h;
+}
+
+static struct sha256_hasher *check_hasher(lua_State *L, int idx) {
+  struct sha256_hasher *h = luaL_checkudata(L, idx, CRYPTO_SHA256_METATABLE);
+  if (h->ctx == NULL) {
+    luaL_error(L, "hasher is closed");
+  }
+  return h;
+}
+
+static void digest(lua_State *L, EVP_MD_CTX *ctx, const char *msg, size_t len, unsigned char *hash) {
+  if (EVP_DigestInit_ex(ctx, sha256_md, NULL) != 1 ||
+      EVP_DigestUpdate(ctx, msg, len) != 1 ||
+      EVP_DigestFinal_ex(ctx, hash, NULL) != 1) {
+    luaL_error(L, "failed to compute digest");
+  }
+}
+
+static int l_crypto_sha256_new(lua_State *L) {
+  struct sha256_hasher *h = new_hasher(L, CRYPTO_SHA256_METATABLE);
+  if (EVP_DigestInit_ex(h->ctx, sha256_md, NULL) != 1) {
+    luaL_error(L, "failed to initialize digest");
+  }
   return 1;
 }
 
 static int l_crypto_sha256_write(lua_State *L) {
-  EVP_MD_CTX *ctx = lua_touserdata(L, 1);
+  struct sha256_hasher *h = check_hasher(L, 1);
   size_t len;
   const char *msg = luaL_checklstring(L, 2, &len);
-  if (EVP_DigestUpdate(ctx, msg, len) != 1) {
+  if (EVP_DigestUpdate(h->ctx, msg, len) != 1) {
     luaL_error(L, "failed to update digest");
     return 0;
   }
@@ -30,19 +88,28 @@ static int l_crypto_sha256_write(lua_State *L) {
 }
 
 static int l_crypto_sha256_reset(lua_State *L) {
-  EVP_MD_CTX *ctx = lua_touserdata(L, 1);
-  if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
+  struct sha256_hasher *h = check_hasher(L, 1);
+  if (EVP_DigestInit_ex(h->ctx, sha256_md, NULL) != 1) {
     luaL_error(L, "failed to reset digest");
     return 0;
   }
   return 0;
 }
 
+// h:Sum() returns the digest of everything written so far and, like Go's
+// hash.Hash, leaves the state alone so writing can go on
 static int l_crypto_sha256_sum(lua_State *L) {
-  EVP_MD_CTX *ctx = lua_touserdata(L, 1);
+  struct sha256_hasher *h = check_hasher(L, 1);
+  if (h->scratch == NULL) {
+    h->scratch = EVP_MD_CTX_new();
+    if (h->scratch == NULL) {
+      luaL_error(L, "failed to allocate EVP_MD_CTX");
+    }
+  }
   unsigned char hash[EVP_MAX_MD_SIZE];
   unsigned int hash_len;
-  if (EVP_DigestFinal_ex(ctx, hash, &hash_len) != 1) {
+  if (EVP_MD_CTX_copy_ex(h->scratch, h->ctx) != 1 ||
+      EVP_DigestFinal_ex(h->scratch, hash, &hash_len) != 1) {
     luaL_error(L, "failed to finalize digest");
     return 0;
   }
@@ -50,22 +117,468 @@ static int l_crypto_sha256_sum(lua_State *L) {
   return 1;
 }
 
+// h:Copy() returns an independent hasher with the same state
+static int l_crypto_sha256_copy(lua_State *L) {
+  struct sha256_hasher *h = check_hasher(L, 1);
+  struct sha256_hasher *dup = new_hasher(L, CRYPTO_SHA256_METATABLE);
+  if (EVP_MD_CTX_copy_ex(dup->ctx, h->ctx) != 1) {
+    luaL_error(L, "failed to copy digest");
+  }
+  return 1;
+}
+
 static int l_crypto_sha256_gc(lua_State *L) {
-  EVP_MD_CTX *ctx = lua_touserdata(L, 1);
-  EVP_MD_CTX_free(ctx);
+  struct sha256_hasher *h = lua_touserdata(L, 1);
+  EVP_MD_CTX_free(h->ctx);
+  EVP_MD_CTX_free(h->scratch);
+  h->ctx = NULL;
+  h->scratch = NULL;
   return 0;
 }
 
+// The one-shot functions share a context kept as their upvalue, so a
+// digest costs one call and no allocation.
+
+// sha256.Sum(data) returns the digest of data
+static int l_crypto_sha256_sum_once(lua_State *L) {
+  struct sha256_hasher *shared = lua_touserdata(L, lua_upvalueindex(1));
+  size_t len;
+  const char *msg = luaL_checklstring(L, 1, &len);
+  unsigned char hash[SHA256_SIZE];
+  digest(L, shared->ctx, msg, len, hash);
+  lua_pushlstring(L, (const char *)hash, SHA256_SIZE);
+  return 1;
+}
+
+// sha256.SumMany(list) returns a list with the digest of every item
+static int l_crypto_sha256_sum_many(lua_State *L) {
+  struct sha256_hasher *shared = lua_touserdata(L, lua_upvalueindex(1));
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_Integer n = luaL_len(L, 1);
+  lua_createtable(L, (int)n, 0);
+  for (lua_Integer i = 1; i <= n; ++i) {
+    lua_rawgeti(L, 1, i);
+    size_t len;
+    const char *msg = lua_tolstring(L, -1, &len);
+    if (msg == NULL) {
+      luaL_error(L, "item %d: string expected, got %s", (int)i, luaL_typename(L, -1));
+    }
+    unsigned char hash[SHA256_SIZE];
+    digest(L, shared->ctx, msg, len, hash);
+    lua_pushlstring(L, (const char *)hash, SHA256_SIZE);
+    lua_rawseti(L, -3, i);
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+// SumBatch runs several messages through the compression function at once,
+// one per lane of a vector kernel: AVX-512 and AVX2 kernels compute the
+// rounds of 16 or 8 messages in the lanes of one register, the SHA-NI
+// kernel interleaves the round instructions of two messages. Kernels take
+// one block per lane and the state word-major, state[word][lane]. Each
+// lane streams the full blocks of its message from the Lua string and
+// then one or two padded blocks from its own tail buffer, and picks up the
+// next message as soon as it is done.
+
+static const uint32_t sha256_iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+typedef void (*sha256_batch_kernel)(uint32_t state[8][SHA256_MAX_LANES], const unsigned char *const blocks[SHA256_MAX_LANES]);
+
+#ifdef SHA256_SIMD_X86
+// turns the first 32 bytes of 8 blocks into big-endian words 0-7 of 8 lanes
+__attribute__((target("avx2")))
+static inline void transpose_8x8_avx2(__m256i r[8]) {
+  const __m256i bswap = _mm256_setr_epi8(
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256i t[8], u[8];
+  for (int i = 0; i < 8; i += 2) {
+    __m256i a = _mm256_shuffle_epi8(r[i], bswap);
+    __m256i b = _mm256_shuffle_epi8(r[i+1], bswap);
+    t[i] = _mm256_unpacklo_epi32(a, b);
+    t[i+1] = _mm256_unpackhi_epi32(a, b);
+  }
+  for (int i = 0; i < 8; i += 4) {
+    u[i+0] = _mm256_unpacklo_epi64(t[i+0], t[i+2]);
+    u[i+1] = _mm256_unpackhi_epi64(t[i+0], t[i+2]);
+    u[i+2] = _mm256_unpacklo_epi64(t[i+1], t[i+3]);
+    u[i+3] = _mm256_unpackhi_epi64(t[i+1], t[i+3]);
+  }
+  for (int i = 0; i < 4; ++i) {
+    r[i] = _mm256_permute2x128_si256(u[i], u[i+4], 0x20);
+    r[i+4] = _mm256_permute2x128_si256(u[i], u[i+4], 0x31);
+  }
+}
+
+#define ROTR256(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+__attribute__((target("avx2")))
+static void compress_x8_avx2(uint32_t state[8][SHA256_MAX_LANES], const unsigned char *const blocks[SHA256_MAX_LANES]) {
+  __m256i w[16], v[8], s[8];
+  for (int l = 0; l < 8; ++l) {
+    w[l] = _mm256_loadu_si256((const __m256i *)blocks[l]);
+    w[l+8] = _mm256_loadu_si256((const __m256i *)(blocks[l] + 32));
+  }
+  transpose_8x8_avx2(w);
+  transpose_8x8_avx2(w + 8);
+  for (int i = 0; i < 8; ++i) {
+    s[i] = v[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+  }
+  for (int t = 0; t < 64; ++t) {
+    if (t >= 16) {
+      __m256i w15 = w[(t-15)&15], w2 = w[(t-2)&15];
+      __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(w15, 7), ROTR256(w15, 18)), _mm256_srli_epi32(w15, 3));
+      __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(w2, 17), ROTR256(w2, 19)), _mm256_srli_epi32(w2, 10));
+      w[t&15] = _mm256_add_epi32(_mm256_add_epi32(w[t&15], s0), _mm256_add_epi32(w[(t-7)&15], s1));
+    }
+    __m256i a = v[0], e = v[4];
+    __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(e, 6), ROTR256(e, 11)), ROTR256(e, 25));
+    __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, v[5]), _mm256_andnot_si256(e, v[6]));
+    __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(v[7], S1), _mm256_add_epi32(ch, w[t&15]));
+    t1 = _mm256_add_epi32(t1, _mm256_set1_epi32((int)sha256_k[t]));
+    __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(a, 2), ROTR256(a, 13)), ROTR256(a, 22));
+    __m256i maj = _mm256_or_si256(_mm256_and_si256(a, v[1]), _mm256_and_si256(v[2], _mm256_or_si256(a, v[1])));
+    v[7] = v[6];
+    v[6] = v[5];
+    v[5] = v[4];
+    v[4] = _mm256_add_epi32(v[3], t1);
+    v[3] = v[2];
+    v[2] = v[1];
+    v[1] = v[0];
+    v[0] = _mm256_add_epi32(t1, _mm256_add_epi32(S0, maj));
+  }
+  for (int i = 0; i < 8; ++i) {
+    _mm256_storeu_si256((__m256i *)state[i], _mm256_add_epi32(s[i], v[i]));
+  }
+}
+
+#undef ROTR256
+
+__attribute__((target("avx512f,avx512bw")))
+static void compress_x16_avx512(uint32_t state[8][SHA256_MAX_LANES], const unsigned char *const blocks[SHA256_MAX_LANES]) {
+  __m256i q[4][8];
+  for (int l = 0; l < 8; ++l) {
+    q[0][l] = _mm256_loadu_si256((const __m256i *)blocks[l]);
+    q[1][l] = _mm256_loadu_si256((const __m256i *)blocks[l+8]);
+    q[2][l] = _mm256_loadu_si256((const __m256i *)(blocks[l] + 32));
+    q[3][l] = _mm256_loadu_si256((const __m256i *)(blocks[l+8] + 32));
+  }
+  __m512i w[16], v[8], s[8];
+  for (int i = 0; i < 4; ++i) {
+    transpose_8x8_avx2(q[i]);
+  }
+  for (int i = 0; i < 8; ++i) {
+    w[i] = _mm512_inserti64x4(_mm512_castsi256_si512(q[0][i]), q[1][i], 1);
+    w[i+8] = _mm512_inserti64x4(_mm512_castsi256_si512(q[2][i]), q[3][i], 1);
+    s[i] = v[i] = _mm512_loadu_si512(state[i]);
+  }
+  for (int t = 0; t < 64; ++t) {
+    if (t >= 16) {
+      __m512i w15 = w[(t-15)&15], w2 = w[(t-2)&15];
+      __m512i s0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w15, 7), _mm512_ror_epi32(w15, 18), _mm512_srli_epi32(w15, 3), 0x96);
+      __m512i s1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w2, 17), _mm512_ror_epi32(w2, 19), _mm512_srli_epi32(w2, 10), 0x96);
+      w[t&15] = _mm512_add_epi32(_mm512_add_epi32(w[t&15], s0), _mm512_add_epi32(w[(t-7)&15], s1));
+    }
+    __m512i a = v[0], e = v[4];
+    __m512i S1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11), _mm512_ror_epi32(e, 25), 0x96);
+    // 0xCA is e ? f : g, 0xE8 the majority of a, b and c
+    __m512i ch = _mm512_ternarylogic_epi32(e, v[5], v[6], 0xCA);
+    __m512i t1 = _mm512_add_epi32(_mm512_add_epi32(v[7], S1), _mm512_add_epi32(ch, w[t&15]));
+    t1 = _mm512_add_epi32(t1, _mm512_set1_epi32((int)sha256_k[t]));
+    __m512i S0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13), _mm512_ror_epi32(a, 22), 0x96);
+    __m512i maj = _mm512_ternarylogic_epi32(a, v[1], v[2], 0xE8);
+    v[7] = v[6];
+    v[6] = v[5];
+    v[5] = v[4];
+    v[4] = _mm512_add_epi32(v[3], t1);
+    v[3] = v[2];
+    v[2] = v[1];
+    v[1] = v[0];
+    v[0] = _mm512_add_epi32(t1, _mm512_add_epi32(S0, maj));
+  }
+  for (int i = 0; i < 8; ++i) {
+    _mm512_storeu_si512(state[i], _mm512_add_epi32(s[i], v[i]));
+  }
+}
+
+// SHA-NI keeps the state as ABEF and CDGH and runs two rounds per
+// instruction; the two messages are independent chains, so their rounds
+// overlap in the pipeline
+__attribute__((target("sha,sse4.1")))
+static void compress_x2_shani(uint32_t state[8][SHA256_MAX_LANES], const unsigned char *const blocks[SHA256_MAX_LANES]) {
+  const __m128i bswap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m128i abef[2], cdgh[2], abef_save[2], cdgh_save[2], m[2][4];
+  for (int j = 0; j < 2; ++j) {
+    __m128i dcba = _mm_setr_epi32((int)state[0][j], (int)state[1][j], (int)state[2][j], (int)state[3][j]);
+    __m128i hgfe = _mm_setr_epi32((int)state[4][j], (int)state[5][j], (int)state[6][j], (int)state[7][j]);
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+    abef_save[j] = abef[j] = _mm_alignr_epi8(cdab, efgh, 8);
+    cdgh_save[j] = cdgh[j] = _mm_blend_epi16(efgh, cdab, 0xF0);
+    for (int i = 0; i < 4; ++i) {
+      m[j][i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks[j] + 16 * i)), bswap);
+    }
+  }
+#pragma GCC unroll 16
+  for (int i = 0; i < 16; ++i) {
+    const __m128i k = _mm_loadu_si128((const __m128i *)(sha256_k + 4 * i));
+#pragma GCC unroll 2
+    for (int j = 0; j < 2; ++j) {
+      __m128i msg = _mm_add_epi32(m[j][i&3], k);
+      cdgh[j] = _mm_sha256rnds2_epu32(cdgh[j], abef[j], msg);
+      // words of the group after next: msg1, the w[t-7] term and msg2
+      if (i >= 3 && i <= 14) {
+        __m128i w7 = _mm_alignr_epi8(m[j][i&3], m[j][(i-1)&3], 4);
+        m[j][(i+1)&3] = _mm_sha256msg2_epu32(_mm_add_epi32(m[j][(i+1)&3], w7), m[j][i&3]);
+      }
+      abef[j] = _mm_sha256rnds2_epu32(abef[j], cdgh[j], _mm_shuffle_epi32(msg, 0x0E));
+      if (i >= 1 && i <= 12) {
+        m[j][(i-1)&3] = _mm_sha256msg1_epu32(m[j][(i-1)&3], m[j][i&3]);
+      }
+    }
+  }
+  for (int j = 0; j < 2; ++j) {
+    __m128i feba = _mm_shuffle_epi32(_mm_add_epi32(abef[j], abef_save[j]), 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(_mm_add_epi32(cdgh[j], cdgh_save[j]), 0xB1);
+    uint32_t out[8];
+    _mm_storeu_si128((__m128i *)out, _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i *)(out + 4), _mm_alignr_epi8(dchg, feba, 8));
+    for (int i = 0; i < 8; ++i) {
+      state[i][j] = out[i];
+    }
+  }
+}
+#endif
+
+static sha256_batch_kernel sha256_batch;
+static int sha256_batch_lanes;
+
+struct sha256_lane {
+  lua_Integer item; // 0 when the lane is idle
+  const unsigned char *data;
+  size_t full; // full blocks left in data
+  const unsigned char *tail;
+  size_t tail_blocks; // padded blocks left in tail
+  unsigned char tail_buf[2 * SHA256_BLOCK_SIZE];
+};
+
+static void lane_start(struct sha256_lane *ln, uint32_t state[8][SHA256_MAX_LANES], int l,
+                       lua_Integer item, const unsigned char *msg, size_t len) {
+  for (int i = 0; i < 8; ++i) {
+    state[i][l] = sha256_iv[i];
+  }
+  ln->item = item;
+  ln->data = msg;
+  ln->full = len / SHA256_BLOCK_SIZE;
+  size_t rest = len % SHA256_BLOCK_SIZE;
+  ln->tail_blocks = rest < SHA256_BLOCK_SIZE - 8 ? 1 : 2;
+  size_t end = ln->tail_blocks * SHA256_BLOCK_SIZE;
+  memcpy(ln->tail_buf, msg + len - rest, rest);
+  ln->tail_buf[rest] = 0x80;
+  memset(ln->tail_buf + rest + 1, 0, end - rest - 1);
+  uint64_t bits = (uint64_t)len * 8;
+  for (int i = 1; i <= 8; ++i, bits >>= 8) {
+    ln->tail_buf[end - i] = (unsigned char)bits;
+  }
+  ln->tail = ln->tail_buf;
+}
+
+static const unsigned char *lane_next_block(struct sha256_lane *ln) {
+  const unsigned char *block;
+  if (ln->full > 0) {
+    block = ln->data;
+    ln->data += SHA256_BLOCK_SIZE;
+    --ln->full;
+  } else {
+    block = ln->tail;
+    ln->tail += SHA256_BLOCK_SIZE;
+    --ln->tail_blocks;
+  }
+  return block;
+}
+
+// gives lane l the next message of the list at index 1 that suits a lane;
+// the others are hashed with EVP right away; results go to the table at
+// index 2
+static void lane_fetch(lua_State *L, EVP_MD_CTX *ctx, struct sha256_lane *ln, uint32_t state[8][SHA256_MAX_LANES],
+                       int l, lua_Integer *next, lua_Integer n, size_t max_len) {
+  ln->item = 0;
+  while (*next <= n) {
+    lua_Integer i = (*next)++;
+    lua_rawgeti(L, 1, i);
+    if (lua_type(L, -1) != LUA_TSTRING) {
+      luaL_error(L, "item %d: string expected, got %s", (int)i, luaL_typename(L, -1));
+    }
+    // the list keeps the string alive
+    size_t len;
+    const char *msg = lua_tolstring(L, -1, &len);
+    lua_pop(L, 1);
+    if (len < max_len) {
+      lane_start(ln, state, l, i, (const unsigned char *)msg, len);
+      return;
+    }
+    unsigned char hash[SHA256_SIZE];
+    digest(L, ctx, msg, len, hash);
+    lua_pushlstring(L, (const char *)hash, SHA256_SIZE);
+    lua_rawseti(L, 2, i);
+  }
+}
+
+// sha256.SumBatch(list) returns the same list as SumMany, hashing the
+// messages side by side where the CPU allows
+static int l_crypto_sha256_sum_batch(lua_State *L) {
+  struct sha256_hasher *shared = lua_touserdata(L, lua_upvalueindex(1));
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_Integer n = luaL_len(L, 1);
+  lua_settop(L, 1);
+  lua_createtable(L, (int)n, 0);
+  int lanes = sha256_batch_lanes;
+  size_t max_len = sha256_batch != NULL ? SHA256_BATCH_MAX_LEN : 0;
+  // idle lanes hash this block and drop the result
+  static const unsigned char idle_block[SHA256_BLOCK_SIZE];
+  struct sha256_lane lane[SHA256_MAX_LANES];
+  uint32_t state[8][SHA256_MAX_LANES];
+  const unsigned char *blocks[SHA256_MAX_LANES];
+  lua_Integer next = 1;
+  int active = 0;
+  for (int l = 0; l < lanes; ++l) {
+    lane_fetch(L, shared->ctx, &lane[l], state, l, &next, n, max_len);
+    active += lane[l].item != 0;
+  }
+  while (active > 0) {
+    for (int l = 0; l < lanes; ++l) {
+      blocks[l] = lane[l].item != 0 ? lane_next_block(&lane[l]) : idle_block;
+    }
+    sha256_batch(state, blocks);
+    for (int l = 0; l < lanes; ++l) {
+      if (lane[l].item == 0 || lane[l].full > 0 || lane[l].tail_blocks > 0) {
+        continue;
+      }
+      unsigned char hash[SHA256_SIZE];
+      for (int i = 0; i < 8; ++i) {
+        hash[4*i+0] = (unsigned char)(state[i][l] >> 24);
+        hash[4*i+1] = (unsigned char)(state[i][l] >> 16);
+        hash[4*i+2] = (unsigned char)(state[i][l] >> 8);
+        hash[4*i+3] = (unsigned char)state[i][l];
+      }
+      lua_pushlstring(L, (const char *)hash, SHA256_SIZE);
+      lua_rawseti(L, 2, lane[l].item);
+      lane_fetch(L, shared->ctx, &lane[l], state, l, &next, n, max_len);
+      active -= lane[l].item == 0;
+    }
+  }
+  return 1;
+}
+
+// An HMAC object holds the states after the inner and outer key pads, so
+// signing a message copies them and runs just the message and the inner
+// digest through the compression function.
+struct sha256_hmac {
+  SHA256_CTX inner;
+  SHA256_CTX outer;
+};
+
+// sha256.NewHMAC(key) returns an object whose :Sum(msg) is HMAC-SHA256
+static int l_crypto_sha256_new_hmac(lua_State *L) {
+  size_t len;
+  const char *key = luaL_checklstring(L, 1, &len);
+  unsigned char k[SHA256_BLOCK_SIZE] = {0};
+  if (len > SHA256_BLOCK_SIZE) {
+    SHA256((const unsigned char *)key, len, k);
+  } else {
+    memcpy(k, key, len);
+  }
+  struct sha256_hmac *h = lua_newuserdata(L, sizeof(struct sha256_hmac));
+  luaL_getmetatable(L, CRYPTO_SHA256_HMAC_METATABLE);
+  lua_setmetatable(L, -2);
+  unsigned char pad[SHA256_BLOCK_SIZE];
+  for (int i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+    pad[i] = k[i] ^ 0x36;
+  }
+  SHA256_Init(&h->inner);
+  SHA256_Update(&h->inner, pad, SHA256_BLOCK_SIZE);
+  for (int i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+    pad[i] = k[i] ^ 0x5c;
+  }
+  SHA256_Init(&h->outer);
+  SHA256_Update(&h->outer, pad, SHA256_BLOCK_SIZE);
+  OPENSSL_cleanse(k, sizeof(k));
+  OPENSSL_cleanse(pad, sizeof(pad));
+  return 1;
+}
+
+static int l_crypto_sha256_hmac_sum(lua_State *L) {
+  struct sha256_hmac *h = luaL_checkudata(L, 1, CRYPTO_SHA256_HMAC_METATABLE);
+  size_t len;
+  const char *msg = luaL_checklstring(L, 2, &len);
+  unsigned char hash[SHA256_SIZE];
+  SHA256_CTX ctx = h->inner;
+  SHA256_Update(&ctx, msg, len);
+  SHA256_Final(hash, &ctx);
+  ctx = h->outer;
+  SHA256_Update(&ctx, hash, SHA256_SIZE);
+  SHA256_Final(hash, &ctx);
+  OPENSSL_cleanse(&ctx, sizeof(ctx));
+  lua_pushlstring(L, (const char *)hash, SHA256_SIZE);
+  return 1;
+}
+
+static int l_crypto_sha256_hmac_gc(lua_State *L) {
+  struct sha256_hmac *h = lua_touserdata(L, 1);
+  OPENSSL_cleanse(h, sizeof(struct sha256_hmac));
+  return 0;
+}
+
+// sha256.Equal(a, b) compares in time that depends only on the lengths
+static int l_crypto_sha256_equal(lua_State *L) {
+  size_t alen, blen;
+  const char *a = luaL_checklstring(L, 1, &alen);
+  const char *b = luaL_checklstring(L, 2, &blen);
+  lua_pushboolean(L, alen == blen && CRYPTO_memcmp(a, b, alen) == 0);
+  return 1;
+}
+
 static const luaL_Reg crypto_sha256_methods[] = {
   {"Write", l_crypto_sha256_write},
   {"Reset", l_crypto_sha256_reset},
   {"Sum", l_crypto_sha256_sum},
+  {"Copy", l_crypto_sha256_copy},
+  {"__gc", l_crypto_sha256_gc},
+  {NULL, NULL}
+};
+
+static const luaL_Reg crypto_sha256_hmac_methods[] = {
+  {"Sum", l_crypto_sha256_hmac_sum},
+  {"__gc", l_crypto_sha256_hmac_gc},
+  {NULL, NULL}
+};
+
+static const luaL_Reg crypto_sha256_context_methods[] = {
   {"__gc", l_crypto_sha256_gc},
   {NULL, NULL}
 };
 
 static const luaL_Reg crypto_sha256_functions[] = {
   {"New", l_crypto_sha256_new},
+  {"Sum", l_crypto_sha256_sum_once},
+  {"SumMany", l_crypto_sha256_sum_many},
+  {"SumBatch", l_crypto_sha256_sum_batch},
+  {"NewHMAC", l_crypto_sha256_new_hmac},
+  {"Equal", l_crypto_sha256_equal},
   {NULL, NULL}
 };
 
@@ -77,14 +590,67 @@ static void create_crypto_sha256_metatable(lua_State *L) {
   lua_pop(L, 1);
 }
 
+static void create_crypto_sha256_hmac_metatable(lua_State *L) {
+  luaL_newmetatable(L, CRYPTO_SHA256_HMAC_METATABLE);
+  luaL_setfuncs(L, crypto_sha256_hmac_methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
+static void create_crypto_sha256_context_metatable(lua_State *L) {
+  luaL_newmetatable(L, CRYPTO_SHA256_CONTEXT_METATABLE);
+  luaL_setfuncs(L, crypto_sha256_context_methods, 0);
+  lua_pop(L, 1);
+}
+
 static void add_const(lua_State *L) {
-  lua_pushinteger(L, 32);
+  lua_pushinteger(L, SHA256_SIZE);
   lua_setfield(L, -2, "Size");
 }
 
+static void fetch_md(lua_State *L) {
+  if (sha256_md != NULL) {
+    return;
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  sha256_md = EVP_MD_fetch(NULL, "SHA256", NULL);
+#else
+  sha256_md = EVP_sha256();
+#endif
+  if (sha256_md == NULL) {
+    luaL_error(L, "failed to fetch SHA256");
+  }
+}
+
+static void select_batch_kernel(void) {
+  // without a kernel every message takes the EVP path
+  sha256_batch_lanes = 1;
+#ifdef SHA256_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    sha256_batch = compress_x16_avx512;
+    sha256_batch_lanes = 16;
+  } else if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+    // two SHA-NI chains beat eight AVX2 lanes
+    sha256_batch = compress_x2_shani;
+    sha256_batch_lanes = 2;
+  } else if (__builtin_cpu_supports("avx2")) {
+    sha256_batch = compress_x8_avx2;
+    sha256_batch_lanes = 8;
+  }
+#endif
+}
+
 int luaopen_crypto_sha256(lua_State *L) {
+  fetch_md(L);
+  select_batch_kernel();
   create_crypto_sha256_metatable(L);
-  luaL_newlib(L, crypto_sha256_functions);
+  create_crypto_sha256_hmac_metatable(L);
+  create_crypto_sha256_context_metatable(L);
+  luaL_newlibtable(L, crypto_sha256_functions);
+  new_hasher(L, CRYPTO_SHA256_CONTEXT_METATABLE);
+  luaL_setfuncs(L, crypto_sha256_functions, 1);
   add_const(L);
   return 1;
-}
\ No newline at end of file
+}
@@ -2,53 +2,312 @@
 #include <lualib.h>
 #include <lauxlib.h>
 
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_SIMD_X86
+#endif
+
 #define ENCODING_BASE64_METATABLE "encoding.base64"
+#define ENCODING_BASE64_ENCODER_METATABLE "encoding.base64.encoder"
+#define ENCODING_BASE64_DECODER_METATABLE "encoding.base64.decoder"
+#define ENCODING_BASE64_BUFFER_METATABLE "encoding.base64.buffer"
 
 #define ENCODE_STD "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
 #define ENCODE_URL "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
 #define PADDING_CHAR '='
+// marks bytes outside the alphabet in decode_map, has the top bit set
+#define INVALID_CHAR 0xFF
+// vector decoders store up to this many bytes past the decoded data
+#define DECODE_SLACK 8
+#define ILLEGAL_DATA_ERROR "illegal base64 data at input byte %d"
+#define BAD_LENGTH_ERROR "data length is not a multiple of four"
+// batch calls start with a scratch buffer on the C stack
+#define SCRATCH_SIZE 1024
 
 struct encoding {
   char encode_map[64];
-  char decode_map[256];
+  unsigned char decode_map[256];
 };
 
 static void encoding_init(struct encoding *enc, const char *encoder) {
   for (int i = 0; i < 64; ++i) {
     enc->encode_map[i] = encoder[i];
   }
+  memset(enc->decode_map, INVALID_CHAR, sizeof(enc->decode_map));
   for (int i = 0; i < 64; ++i) {
     enc->decode_map[(unsigned char)encoder[i]] = i;
   }
 }
 
+// Block kernels work on whole 3-byte groups when encoding and whole 4-char
+// groups when decoding and return how much input they consumed; padding is
+// left to the callers. The vector kernels translate through the alphabet
+// with byte shuffles over encode_map and the low half of decode_map, so
+// custom alphabets take the same path as the built-in ones, and hand what
+// is left over to the scalar kernels. A decoder stops in front of the
+// first group holding a byte outside the alphabet.
+
+static size_t encode_scalar(const struct encoding *enc, const unsigned char *src, size_t len, char *dst) {
+  const char *map = enc->encode_map;
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3, dst += 4) {
+    dst[0] = map[src[i+0]>>2];
+    dst[1] = map[((src[i+0]&0x3)<<4) | src[i+1]>>4];
+    dst[2] = map[((src[i+1]&0xF)<<2) | src[i+2]>>6];
+    dst[3] = map[src[i+2]&0x3F];
+  }
+  return i;
+}
+
+static size_t decode_scalar(const struct encoding *enc, const char *src, size_t len, char *dst) {
+  const unsigned char *map = enc->decode_map;
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4, dst += 3) {
+    unsigned char c1 = map[(unsigned char)src[i+0]];
+    unsigned char c2 = map[(unsigned char)src[i+1]];
+    unsigned char c3 = map[(unsigned char)src[i+2]];
+    unsigned char c4 = map[(unsigned char)src[i+3]];
+    if ((c1 | c2 | c3 | c4) & 0x80) {
+      break;
+    }
+    dst[0] = (char)(c1<<2 | c2>>4);
+    dst[1] = (char)(c2<<4 | c3>>2);
+    dst[2] = (char)(c3<<6 | c4);
+  }
+  return i;
+}
+
+#ifdef BASE64_SIMD_X86
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const struct encoding *enc, const unsigned char *src, size_t len, char *dst) {
+  const __m128i lut0 = _mm_loadu_si128((const __m128i *)(enc->encode_map + 0));
+  const __m128i lut1 = _mm_loadu_si128((const __m128i *)(enc->encode_map + 16));
+  const __m128i lut2 = _mm_loadu_si128((const __m128i *)(enc->encode_map + 32));
+  const __m128i lut3 = _mm_loadu_si128((const __m128i *)(enc->encode_map + 48));
+  const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  size_t i = 0;
+  // 12 bytes per round, the load reads 16
+  for (; i + 16 <= len; i += 12, dst += 16) {
+    __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), spread);
+    __m128i hi6 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i lo6 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    __m128i idx = _mm_or_si128(hi6, lo6);
+    __m128i group = _mm_and_si128(_mm_srli_epi16(idx, 4), _mm_set1_epi8(0x3));
+    __m128i out = _mm_and_si128(_mm_shuffle_epi8(lut0, idx), _mm_cmpeq_epi8(group, _mm_set1_epi8(0)));
+    out = _mm_or_si128(out, _mm_and_si128(_mm_shuffle_epi8(lut1, idx), _mm_cmpeq_epi8(group, _mm_set1_epi8(1))));
+    out = _mm_or_si128(out, _mm_and_si128(_mm_shuffle_epi8(lut2, idx), _mm_cmpeq_epi8(group, _mm_set1_epi8(2))));
+    out = _mm_or_si128(out, _mm_and_si128(_mm_shuffle_epi8(lut3, idx), _mm_cmpeq_epi8(group, _mm_set1_epi8(3))));
+    _mm_storeu_si128((__m128i *)dst, out);
+  }
+  return i + encode_scalar(enc, src + i, len - i, dst);
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const struct encoding *enc, const char *src, size_t len, char *dst) {
+  __m128i lut[8];
+  for (int h = 0; h < 8; ++h) {
+    lut[h] = _mm_loadu_si128((const __m128i *)(enc->decode_map + 16 * h));
+  }
+  const __m128i invalid = _mm_set1_epi8((char)INVALID_CHAR);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t i = 0;
+  // 12 bytes out per round, the store writes 16
+  for (; i + 16 <= len; i += 16, dst += 12) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i row = _mm_and_si128(_mm_srli_epi16(in, 4), _mm_set1_epi8(0xF));
+    __m128i v = _mm_setzero_si128();
+    for (int h = 0; h < 8; ++h) {
+      v = _mm_or_si128(v, _mm_and_si128(_mm_shuffle_epi8(lut[h], in), _mm_cmpeq_epi8(row, _mm_set1_epi8((char)h))));
+    }
+    // bytes from 0x80 up select nothing and are caught by their top bit
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, invalid), in)) != 0) {
+      break;
+    }
+    __m128i merged = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(merged, pack));
+  }
+  return i + decode_scalar(enc, src + i, len - i, dst);
+}
+
+__attribute__((target("avx2")))
+static size_t encode_avx2(const struct encoding *enc, const unsigned char *src, size_t len, char *dst) {
+  const __m256i lut0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(enc->encode_map + 0)));
+  const __m256i lut1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(enc->encode_map + 16)));
+  const __m256i lut2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(enc->encode_map + 32)));
+  const __m256i lut3 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(enc->encode_map + 48)));
+  const __m256i spread = _mm256_set_epi8(
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  size_t i = 0;
+  // 24 bytes per round as two lanes of 12, the second load reads up to i + 28
+  for (; i + 28 <= len; i += 24, dst += 32) {
+    __m256i in = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i))),
+      _mm_loadu_si128((const __m128i *)(src + i + 12)), 1);
+    in = _mm256_shuffle_epi8(in, spread);
+    __m256i hi6 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+    __m256i lo6 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+    __m256i idx = _mm256_or_si256(hi6, lo6);
+    __m256i group = _mm256_and_si256(_mm256_srli_epi16(idx, 4), _mm256_set1_epi8(0x3));
+    __m256i out = _mm256_and_si256(_mm256_shuffle_epi8(lut0, idx), _mm256_cmpeq_epi8(group, _mm256_set1_epi8(0)));
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_shuffle_epi8(lut1, idx), _mm256_cmpeq_epi8(group, _mm256_set1_epi8(1))));
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_shuffle_epi8(lut2, idx), _mm256_cmpeq_epi8(group, _mm256_set1_epi8(2))));
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_shuffle_epi8(lut3, idx), _mm256_cmpeq_epi8(group, _mm256_set1_epi8(3))));
+    _mm256_storeu_si256((__m256i *)dst, out);
+  }
+  return i + encode_ssse3(enc, src + i, len - i, dst);
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const struct encoding *enc, const char *src, size_t len, char *dst) {
+  __m256i lut[8];
+  for (int h = 0; h < 8; ++h) {
+    lut[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(enc->decode_map + 16 * h)));
+  }
+  const __m256i invalid = _mm256_set1_epi8((char)INVALID_CHAR);
+  const __m256i pack = _mm256_setr_epi8(
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  size_t i = 0;
+  // 24 bytes out per round, the store writes 32
+  for (; i + 32 <= len; i += 32, dst += 24) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i row = _mm256_and_si256(_mm256_srli_epi16(in, 4), _mm256_set1_epi8(0xF));
+    __m256i v = _mm256_setzero_si256();
+    for (int h = 0; h < 8; ++h) {
+      v = _mm256_or_si256(v, _mm256_and_si256(_mm256_shuffle_epi8(lut[h], in), _mm256_cmpeq_epi8(row, _mm256_set1_epi8((char)h))));
+    }
+    if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, invalid), in)) != 0) {
+      break;
+    }
+    __m256i merged = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    merged = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, pack), compact);
+    _mm256_storeu_si256((__m256i *)dst, merged);
+  }
+  return i + decode_ssse3(enc, src + i, len - i, dst);
+}
+#endif
+
+static size_t (*base64_encode_block)(const struct encoding *enc, const unsigned char *src, size_t len, char *dst) = encode_scalar;
+static size_t (*base64_decode_block)(const struct encoding *enc, const char *src, size_t len, char *dst) = decode_scalar;
+
+// decodes a group of four that may end in padding; returns the byte
+// count, or -1 - i when g[i] is illegal
+static int decode_padded_group(const struct encoding *enc, const char *g, char *out) {
+  const unsigned char *map = enc->decode_map;
+  unsigned char c1 = map[(unsigned char)g[0]];
+  unsigned char c2 = map[(unsigned char)g[1]];
+  if (c1 & 0x80) {
+    return -1;
+  } else if (c2 & 0x80) {
+    return -2;
+  }
+  out[0] = (char)(c1<<2 | c2>>4);
+  if (g[2] == PADDING_CHAR) {
+    return g[3] == PADDING_CHAR ? 1 : -4;
+  }
+  unsigned char c3 = map[(unsigned char)g[2]];
+  if (c3 & 0x80) {
+    return -3;
+  }
+  out[1] = (char)(c2<<4 | c3>>2);
+  if (g[3] == PADDING_CHAR) {
+    return 2;
+  }
+  unsigned char c4 = map[(unsigned char)g[3]];
+  if (c4 & 0x80) {
+    return -4;
+  }
+  out[2] = (char)(c3<<6 | c4);
+  return 3;
+}
+
+static void encode_padded_group(const struct encoding *enc, const unsigned char *data, size_t more, char *out) {
+  if (more == 1) {
+    out[0] = enc->encode_map[data[0]>>2];
+    out[1] = enc->encode_map[(data[0]&0x3)<<4];
+    out[2] = PADDING_CHAR;
+    out[3] = PADDING_CHAR;
+  } else if (more == 2) {
+    out[0] = enc->encode_map[data[0]>>2];
+    out[1] = enc->encode_map[((data[0]&0x3)<<4) | data[1]>>4];
+    out[2] = enc->encode_map[(data[1]&0xF)<<2];
+    out[3] = PADDING_CHAR;
+  }
+}
+
+// encodes len bytes into the (len + 2) / 3 * 4 bytes at out
+static size_t encode_whole(const struct encoding *enc, const unsigned char *data, size_t len, char *out) {
+  size_t di = base64_encode_block(enc, data, len, out);
+  encode_padded_group(enc, data + di, len - di, out + di / 3 * 4);
+  return (len + 2) / 3 * 4;
+}
+
+enum {
+  DECODE_OK,
+  DECODE_BAD_LENGTH,
+  DECODE_ILLEGAL,
+};
+
+// decodes data into out, which needs room for len / 4 * 3 bytes and
+// DECODE_SLACK more for the vector kernels; *result is the decoded size,
+// or the offset of the illegal byte
+static int decode_whole(const struct encoding *enc, const char *data, size_t len, char *out,
+                        size_t (*block)(const struct encoding *, const char *, size_t, char *), size_t *result) {
+  if (len & 3) {
+    *result = len;
+    return DECODE_BAD_LENGTH;
+  }
+  // the last group may be padded and is decoded on its own
+  size_t n = len > 0 && data[len-1] == PADDING_CHAR ? len-4 : len;
+  size_t di = block(enc, data, n, out);
+  if (di != n) {
+    for (; enc->decode_map[(unsigned char)data[di]] != INVALID_CHAR; ++di);
+    *result = di;
+    return DECODE_ILLEGAL;
+  }
+  size_t size = di / 4 * 3;
+  if (len != n) {
+    int r = decode_padded_group(enc, data + di, out + size);
+    if (r < 0) {
+      *result = di - 1 - r;
+      return DECODE_ILLEGAL;
+    }
+    size += r;
+  }
+  *result = size;
+  return DECODE_OK;
+}
+
+// item is the position in a batch, 0 for a single string
+static void decode_error(lua_State *L, int status, size_t pos, lua_Integer item) {
+  if (status == DECODE_BAD_LENGTH) {
+    if (item > 0) {
+      luaL_error(L, "item %d: " BAD_LENGTH_ERROR, (int)item);
+    }
+    luaL_error(L, BAD_LENGTH_ERROR);
+  }
+  if (item > 0) {
+    luaL_error(L, "item %d: " ILLEGAL_DATA_ERROR, (int)item, (int)pos);
+  }
+  luaL_error(L, ILLEGAL_DATA_ERROR, (int)pos);
+}
+
 static int l_encoding_base64_encode(lua_State *L) {
   struct encoding *enc = lua_touserdata(L, 1);
   size_t len;
-  const char *data = lua_tolstring(L, 2, &len);
+  const unsigned char *data = (const unsigned char *)lua_tolstring(L, 2, &len);
+  size_t size = (len + 2) / 3 * 4;
   luaL_Buffer buf;
-  luaL_buffinitsize(L, &buf, (len + 2) / 3 * 4);
-  size_t n = (len / 3) * 3;
-  size_t di = 0;
-  for (; di < n; di += 3) {
-    luaL_addchar(&buf, enc->encode_map[(unsigned char)data[di+0]>>2]);
-    luaL_addchar(&buf, enc->encode_map[(((unsigned char)data[di+0]&0x3)<<4) | (unsigned char)data[di+1]>>4]);
-    luaL_addchar(&buf, enc->encode_map[(((unsigned char)data[di+1]&0xF)<<2) | (unsigned char)data[di+2]>>6]);
-    luaL_addchar(&buf, enc->encode_map[(unsigned char)data[di+2]&0x3F]);
-  }
-  size_t more = len - di;
-  if (more == 1) {
-    luaL_addchar(&buf, enc->encode_map[(unsigned char)data[di+0]>>2]);
-    luaL_addchar(&buf, enc->encode_map[((unsigned char)data[di+0]&0x3)<<4]);
-    luaL_addchar(&buf, PADDING_CHAR);
-    luaL_addchar(&buf, PADDING_CHAR);
-  } else if (more == 2) {
-    luaL_addchar(&buf, enc->encode_map[(unsigned char)data[di+0]>>2]);
-    luaL_addchar(&buf, enc->encode_map[(((unsigned char)data[di+0]&0x3)<<4) | (unsigned char)data[di+1]>>4]);
-    luaL_addchar(&buf, enc->encode_map[((unsigned char)data[di+1]&0xF)<<2]);
-    luaL_addchar(&buf, PADDING_CHAR);
-  }
-  luaL_pushresult(&buf);
+  char *out = luaL_buffinitsize(L, &buf, size);
+  encode_whole(enc, data, len, out);
+  luaL_pushresultsize(&buf, size);
   return 1;
 }
 
@@ -56,37 +315,342 @@ static int l_encoding_base64_decode(lua_State *L) {
   struct encoding *enc = lua_touserdata(L, 1);
   size_t len;
   const char *data = lua_tolstring(L, 2, &len);
-  if (len & 3) {
-    luaL_error(L, "data length is not a multiple of four");
-  }
   luaL_Buffer buf;
-  luaL_buffinitsize(L, &buf,  len / 4 * 3);
-  size_t di = 0;
-  size_t n = data[len-1] == PADDING_CHAR ? len-4 : len;
-  char c1, c2, c3, c4;
-  for (; di < n; di += 4) {
-    c1 = enc->decode_map[(unsigned char)data[di+0]];
-    c2 = enc->decode_map[(unsigned char)data[di+1]];
-    c3 = enc->decode_map[(unsigned char)data[di+2]];
-    c4 = enc->decode_map[(unsigned char)data[di+3]];
-    luaL_addchar(&buf, (unsigned char)(c1<<2) | (unsigned char)(c2>>4));
-    luaL_addchar(&buf, (unsigned char)(c2<<4) | (unsigned char)(c3>>2));
-    luaL_addchar(&buf, (unsigned char)(c3<<6) | (unsigned char)(c4>>0));
+  char *out = luaL_buffinitsize(L, &buf, len / 4 * 3 + DECODE_SLACK);
+  size_t result;
+  int status = decode_whole(enc, data, len, out, base64_decode_block, &result);
+  if (status != DECODE_OK) {
+    decode_error(L, status, result, 0);
   }
-  if (len != n) {
-    if (data[di+2] == PADDING_CHAR) {
-      c1 = enc->decode_map[(unsigned char)data[di+0]];
-      c2 = enc->decode_map[(unsigned char)data[di+1]];
-      luaL_addchar(&buf, (unsigned char)(c1<<2) | (unsigned char)(c2>>4));
+  luaL_pushresultsize(&buf, result);
+  return 1;
+}
+
+// Batch calls convert every string of a list in one call, through one
+// scratch buffer that only moves to a userdata for items that outgrow
+// SCRATCH_SIZE.
+
+struct scratch {
+  char *buf;
+  size_t size;
+  int slot; // stack index of the userdata once there is one
+  char init[SCRATCH_SIZE];
+};
+
+static char *scratch_reserve(lua_State *L, struct scratch *s, size_t size) {
+  if (size > s->size) {
+    s->size = size > 2 * s->size ? size : 2 * s->size;
+    s->buf = lua_newuserdata(L, s->size);
+    lua_replace(L, s->slot);
+  }
+  return s->buf;
+}
+
+// enc:EncodeMany(list) returns a list with the encoding of every item
+static int l_encoding_base64_encode_many(lua_State *L) {
+  struct encoding *enc = luaL_checkudata(L, 1, ENCODING_BASE64_METATABLE);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_Integer n = luaL_len(L, 2);
+  lua_settop(L, 2);
+  struct scratch s = {NULL, SCRATCH_SIZE, 3};
+  s.buf = s.init;
+  lua_pushnil(L);
+  lua_createtable(L, (int)n, 0);
+  for (lua_Integer i = 1; i <= n; ++i) {
+    lua_rawgeti(L, 2, i);
+    size_t len;
+    const unsigned char *data = (const unsigned char *)lua_tolstring(L, -1, &len);
+    if (data == NULL) {
+      luaL_error(L, "item %d: string expected, got %s", (int)i, luaL_typename(L, -1));
+    }
+    char *out = scratch_reserve(L, &s, (len + 2) / 3 * 4);
+    lua_pushlstring(L, out, encode_whole(enc, data, len, out));
+    lua_rawseti(L, 4, i);
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+// enc:DecodeMany(list) returns a list with the decoding of every item
+static int l_encoding_base64_decode_many(lua_State *L) {
+  struct encoding *enc = luaL_checkudata(L, 1, ENCODING_BASE64_METATABLE);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_Integer n = luaL_len(L, 2);
+  lua_settop(L, 2);
+  struct scratch s = {NULL, SCRATCH_SIZE, 3};
+  s.buf = s.init;
+  lua_pushnil(L);
+  lua_createtable(L, (int)n, 0);
+  for (lua_Integer i = 1; i <= n; ++i) {
+    lua_rawgeti(L, 2, i);
+    size_t len;
+    const char *data = lua_tolstring(L, -1, &len);
+    if (data == NULL) {
+      luaL_error(L, "item %d: string expected, got %s", (int)i, luaL_typename(L, -1));
+    }
+    char *out = scratch_reserve(L, &s, len / 4 * 3 + DECODE_SLACK);
+    size_t result;
+    int status = decode_whole(enc, data, len, out, base64_decode_block, &result);
+    if (status != DECODE_OK) {
+      decode_error(L, status, result, i);
+    }
+    lua_pushlstring(L, out, result);
+    lua_rawseti(L, 4, i);
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+// enc:DecodeInto(data, buffer [, offset]) decodes into a buffer from
+// base64.NewBuffer starting at the 1-based offset and returns the number
+// of bytes written
+static int l_encoding_base64_decode_into(lua_State *L) {
+  struct encoding *enc = luaL_checkudata(L, 1, ENCODING_BASE64_METATABLE);
+  size_t len;
+  const char *data = luaL_checklstring(L, 2, &len);
+  char *buf = luaL_checkudata(L, 3, ENCODING_BASE64_BUFFER_METATABLE);
+  size_t cap = lua_rawlen(L, 3);
+  lua_Integer offset = luaL_optinteger(L, 4, 1);
+  luaL_argcheck(L, offset >= 1 && (size_t)offset <= cap + 1, 4, "offset out of range");
+  size_t room = cap - (size_t)(offset - 1);
+  size_t need = len / 4 * 3;
+  for (size_t i = len; i > 0 && i + 2 > len && data[i-1] == PADDING_CHAR; --i) {
+    --need;
+  }
+  if ((len & 3) == 0 && need > room) {
+    luaL_error(L, "buffer too small: %d bytes needed, %d available", (int)need, (int)room);
+  }
+  // the vector kernels store past the end of what they decode
+  size_t (*block)(const struct encoding *, const char *, size_t, char *) = base64_decode_block;
+  if (room < len / 4 * 3 + DECODE_SLACK) {
+    block = decode_scalar;
+  }
+  size_t result;
+  int status = decode_whole(enc, data, len, buf + offset - 1, block, &result);
+  if (status != DECODE_OK) {
+    decode_error(L, status, result, 0);
+  }
+  lua_pushinteger(L, (lua_Integer)result);
+  return 1;
+}
+
+// base64.NewBuffer(size) returns a zero-filled byte buffer for DecodeInto
+static int l_encoding_base64_new_buffer(lua_State *L) {
+  lua_Integer size = luaL_checkinteger(L, 1);
+  luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+  void *buf = lua_newuserdata(L, (size_t)size);
+  memset(buf, 0, (size_t)size);
+  luaL_getmetatable(L, ENCODING_BASE64_BUFFER_METATABLE);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// buffer:String([i [, j]]) returns bytes i to j like string.sub
+static int l_encoding_base64_buffer_string(lua_State *L) {
+  const char *buf = luaL_checkudata(L, 1, ENCODING_BASE64_BUFFER_METATABLE);
+  lua_Integer size = (lua_Integer)lua_rawlen(L, 1);
+  lua_Integer i = luaL_optinteger(L, 2, 1);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+  if (i < 0) {
+    i = i < -size ? 1 : size + i + 1;
+  } else if (i == 0) {
+    i = 1;
+  }
+  if (j < 0) {
+    j = size + j + 1;
+  } else if (j > size) {
+    j = size;
+  }
+  lua_pushlstring(L, buf + i - 1, i <= j ? (size_t)(j - i + 1) : 0);
+  return 1;
+}
+
+static int l_encoding_base64_buffer_len(lua_State *L) {
+  luaL_checkudata(L, 1, ENCODING_BASE64_BUFFER_METATABLE);
+  lua_pushinteger(L, (lua_Integer)lua_rawlen(L, 1));
+  return 1;
+}
+
+// Streaming encoders and decoders take input in arbitrary chunks and carry
+// the bytes of an incomplete group over to the next Write. Each keeps a
+// copy of its encoding. A decoder can skip CR and LF, for line-wrapped
+// input; error offsets count every input byte written to it.
+
+struct base64_encoder {
+  struct encoding enc;
+  unsigned char pending[2];
+  size_t npending;
+};
+
+struct base64_decoder {
+  struct encoding enc;
+  char pending[4];
+  size_t pending_pos[4]; // input offsets of the pending chars
+  size_t npending;
+  size_t offset; // input bytes written before the current chunk
+  int ignore_newlines;
+  int done; // a padded group ended the data
+};
+
+// enc:NewEncoder()
+static int l_encoding_base64_new_encoder(lua_State *L) {
+  struct encoding *enc = luaL_checkudata(L, 1, ENCODING_BASE64_METATABLE);
+  struct base64_encoder *e = lua_newuserdata(L, sizeof(*e));
+  e->enc = *enc;
+  e->npending = 0;
+  luaL_getmetatable(L, ENCODING_BASE64_ENCODER_METATABLE);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// encoder:Write(chunk) returns the text of the groups completed so far
+static int l_encoding_base64_encoder_write(lua_State *L) {
+  struct base64_encoder *e = luaL_checkudata(L, 1, ENCODING_BASE64_ENCODER_METATABLE);
+  size_t len;
+  const unsigned char *data = (const unsigned char *)luaL_checklstring(L, 2, &len);
+  size_t size = (e->npending + len) / 3 * 4;
+  luaL_Buffer buf;
+  char *out = luaL_buffinitsize(L, &buf, size);
+  size_t i = 0;
+  if (e->npending > 0) {
+    unsigned char group[3];
+    memcpy(group, e->pending, e->npending);
+    for (; e->npending < 3 && i < len; ++i) {
+      group[e->npending++] = data[i];
+    }
+    if (e->npending < 3) {
+      memcpy(e->pending, group, e->npending);
     } else {
-      c1 = enc->decode_map[(unsigned char)data[di+0]];
-      c2 = enc->decode_map[(unsigned char)data[di+1]];
-      c3 = enc->decode_map[(unsigned char)data[di+2]];
-      luaL_addchar(&buf, (unsigned char)(c1<<2) | (unsigned char)(c2>>4));
-      luaL_addchar(&buf, (unsigned char)(c2<<4) | (unsigned char)(c3>>2));
+      encode_scalar(&e->enc, group, 3, out);
+      out += 4;
+      e->npending = 0;
     }
   }
-  luaL_pushresult(&buf);
+  if (e->npending == 0) {
+    size_t di = base64_encode_block(&e->enc, data + i, len - i, out);
+    i += di;
+    e->npending = len - i;
+    memcpy(e->pending, data + i, e->npending);
+  }
+  luaL_pushresultsize(&buf, size);
+  return 1;
+}
+
+// encoder:Close() returns the padded last group and resets the encoder
+static int l_encoding_base64_encoder_close(lua_State *L) {
+  struct base64_encoder *e = luaL_checkudata(L, 1, ENCODING_BASE64_ENCODER_METATABLE);
+  char out[4];
+  encode_padded_group(&e->enc, e->pending, e->npending, out);
+  lua_pushlstring(L, out, e->npending > 0 ? 4 : 0);
+  e->npending = 0;
+  return 1;
+}
+
+// enc:NewDecoder([opts]), opts.ignore_newlines skips CR and LF
+static int l_encoding_base64_new_decoder(lua_State *L) {
+  struct encoding *enc = luaL_checkudata(L, 1, ENCODING_BASE64_METATABLE);
+  int ignore_newlines = 0;
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "ignore_newlines");
+    ignore_newlines = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+  struct base64_decoder *d = lua_newuserdata(L, sizeof(*d));
+  d->enc = *enc;
+  d->npending = 0;
+  d->offset = 0;
+  d->ignore_newlines = ignore_newlines;
+  d->done = 0;
+  luaL_getmetatable(L, ENCODING_BASE64_DECODER_METATABLE);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// decodes a run of text at input offset pos into *out
+static void decoder_feed(lua_State *L, struct base64_decoder *d, const char *data, size_t len, size_t pos, char **out) {
+  size_t i = 0;
+  if (d->done && len > 0) {
+    luaL_error(L, ILLEGAL_DATA_ERROR, (int)pos);
+  }
+  if (d->npending > 0) {
+    for (; d->npending < 4 && i < len; ++i) {
+      d->pending_pos[d->npending] = pos + i;
+      d->pending[d->npending++] = data[i];
+    }
+    if (d->npending < 4) {
+      return;
+    }
+    int r = decode_padded_group(&d->enc, d->pending, *out);
+    if (r < 0) {
+      luaL_error(L, ILLEGAL_DATA_ERROR, (int)d->pending_pos[-1 - r]);
+    }
+    *out += r;
+    d->npending = 0;
+    d->done = r < 3;
+  }
+  if (!d->done) {
+    size_t whole = (len - i) / 4 * 4;
+    size_t di = base64_decode_block(&d->enc, data + i, whole, *out);
+    *out += di / 4 * 3;
+    i += di;
+    if (di < whole) {
+      // a group with padding or an illegal byte
+      int r = decode_padded_group(&d->enc, data + i, *out);
+      if (r < 0) {
+        luaL_error(L, ILLEGAL_DATA_ERROR, (int)(pos + i - 1 - r));
+      }
+      *out += r;
+      i += 4;
+      d->done = 1;
+    }
+  }
+  if (d->done && i < len) {
+    luaL_error(L, ILLEGAL_DATA_ERROR, (int)(pos + i));
+  }
+  for (; i < len; ++i) {
+    d->pending_pos[d->npending] = pos + i;
+    d->pending[d->npending++] = data[i];
+  }
+}
+
+// decoder:Write(chunk) returns the bytes of the groups completed so far
+static int l_encoding_base64_decoder_write(lua_State *L) {
+  struct base64_decoder *d = luaL_checkudata(L, 1, ENCODING_BASE64_DECODER_METATABLE);
+  size_t len;
+  const char *data = luaL_checklstring(L, 2, &len);
+  luaL_Buffer buf;
+  char *start = luaL_buffinitsize(L, &buf, (d->npending + len) / 4 * 3 + DECODE_SLACK);
+  char *out = start;
+  if (!d->ignore_newlines) {
+    decoder_feed(L, d, data, len, d->offset, &out);
+  } else {
+    size_t i = 0;
+    while (i < len) {
+      size_t j = i;
+      for (; j < len && data[j] != '\r' && data[j] != '\n'; ++j);
+      decoder_feed(L, d, data + i, j - i, d->offset + i, &out);
+      for (; j < len && (data[j] == '\r' || data[j] == '\n'); ++j);
+      i = j;
+    }
+  }
+  d->offset += len;
+  luaL_pushresultsize(&buf, out - start);
+  return 1;
+}
+
+// decoder:Close() fails on an incomplete last group and resets the decoder
+static int l_encoding_base64_decoder_close(lua_State *L) {
+  struct base64_decoder *d = luaL_checkudata(L, 1, ENCODING_BASE64_DECODER_METATABLE);
+  size_t npending = d->npending;
+  size_t offset = d->offset;
+  d->npending = 0;
+  d->offset = 0;
+  d->done = 0;
+  if (npending > 0) {
+    luaL_error(L, ILLEGAL_DATA_ERROR, (int)offset);
+  }
+  lua_pushliteral(L, "");
   return 1;
 }
 
@@ -106,11 +670,35 @@ static int l_encoding_base64_new(lua_State *L) {
 static const luaL_Reg encoding_base64_methods[] = {
   {"Encode", l_encoding_base64_encode},
   {"Decode", l_encoding_base64_decode},
+  {"NewEncoder", l_encoding_base64_new_encoder},
+  {"NewDecoder", l_encoding_base64_new_decoder},
+  {"EncodeMany", l_encoding_base64_encode_many},
+  {"DecodeMany", l_encoding_base64_decode_many},
+  {"DecodeInto", l_encoding_base64_decode_into},
+  {NULL, NULL}
+};
+
+static const luaL_Reg encoding_base64_buffer_methods[] = {
+  {"String", l_encoding_base64_buffer_string},
+  {"__len", l_encoding_base64_buffer_len},
+  {NULL, NULL}
+};
+
+static const luaL_Reg encoding_base64_encoder_methods[] = {
+  {"Write", l_encoding_base64_encoder_write},
+  {"Close", l_encoding_base64_encoder_close},
+  {NULL, NULL}
+};
+
+static const luaL_Reg encoding_base64_decoder_methods[] = {
+  {"Write", l_encoding_base64_decoder_write},
+  {"Close", l_encoding_base64_decoder_close},
   {NULL, NULL}
 };
 
 static const luaL_Reg encoding_base64_functions[] = {
   {"New", l_encoding_base64_new},
+  {"NewBuffer", l_encoding_base64_new_buffer},
   {NULL, NULL}
 };
 
@@ -122,6 +710,30 @@ static void create_encoding_base64_metatable(lua_State *L) {
   lua_pop(L, 1);
 }
 
+static void create_encoding_base64_encoder_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_BASE64_ENCODER_METATABLE);
+  luaL_setfuncs(L, encoding_base64_encoder_methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
+static void create_encoding_base64_decoder_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_BASE64_DECODER_METATABLE);
+  luaL_setfuncs(L, encoding_base64_decoder_methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
+static void create_encoding_base64_buffer_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_BASE64_BUFFER_METATABLE);
+  luaL_setfuncs(L, encoding_base64_buffer_methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
 static void add_const(lua_State *L) {
   struct encoding *std_encoding = lua_newuserdata(L, sizeof(struct encoding));
   encoding_init(std_encoding, ENCODE_STD);
@@ -136,8 +748,25 @@ static void add_const(lua_State *L) {
   lua_setfield(L, -2, "URLEncoding");
 }
 
+static void select_kernels(void) {
+#ifdef BASE64_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    base64_encode_block = encode_avx2;
+    base64_decode_block = decode_avx2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    base64_encode_block = encode_ssse3;
+    base64_decode_block = decode_ssse3;
+  }
+#endif
+}
+
 int luaopen_encoding_base64(lua_State *L) {
+  select_kernels();
   create_encoding_base64_metatable(L);
+  create_encoding_base64_encoder_metatable(L);
+  create_encoding_base64_decoder_metatable(L);
+  create_encoding_base64_buffer_metatable(L);
   luaL_newlib(L, encoding_base64_functions);
   add_const(L);
   return 1;
@@ -0,0 +1,220 @@
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_SIMD_X86
+#endif
+
+#define DIGITS_LOWER "0123456789abcdef"
+#define DIGITS_UPPER "0123456789ABCDEF"
+// marks bytes that are not hex digits in decode_map
+#define INVALID_CHAR 0xFF
+#define ILLEGAL_DATA_ERROR "illegal hex data at input byte %d"
+
+static unsigned char decode_map[256];
+
+static void decode_map_init(void) {
+  memset(decode_map, INVALID_CHAR, sizeof(decode_map));
+  for (int i = 0; i < 16; ++i) {
+    decode_map[(unsigned char)DIGITS_LOWER[i]] = i;
+    decode_map[(unsigned char)DIGITS_UPPER[i]] = i;
+  }
+}
+
+// Kernels return how much input they consumed. The vector encoders split
+// every byte into nibbles and translate them with one shuffle over the
+// digit table; the vector decoders fold letters to lower case, range check
+// every char and stop in front of the first block holding a non-digit,
+// leaving the rest and the exact error position to the scalar decoder.
+// Decoders accept either case.
+
+static size_t encode_scalar(const char *digits, const unsigned char *src, size_t len, char *dst) {
+  for (size_t i = 0; i < len; ++i, dst += 2) {
+    dst[0] = digits[src[i]>>4];
+    dst[1] = digits[src[i]&0xF];
+  }
+  return len;
+}
+
+static size_t decode_scalar(const char *src, size_t len, char *dst) {
+  size_t i = 0;
+  for (; i + 2 <= len; i += 2, ++dst) {
+    unsigned char hi = decode_map[(unsigned char)src[i]];
+    unsigned char lo = decode_map[(unsigned char)src[i+1]];
+    if ((hi | lo) & 0x80) {
+      break;
+    }
+    *dst = (char)(hi<<4 | lo);
+  }
+  return i;
+}
+
+#ifdef HEX_SIMD_X86
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const char *digits, const unsigned char *src, size_t len, char *dst) {
+  const __m128i lut = _mm_loadu_si128((const __m128i *)digits);
+  const __m128i nibble = _mm_set1_epi8(0xF);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16, dst += 32) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(in, 4), nibble));
+    __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(in, nibble));
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  return i + encode_scalar(digits, src + i, len - i, dst);
+}
+
+// nibble values of 16 chars, or a zero movemask bit where a char is not a
+// hex digit; chars from 0x80 up are negative and fail both ranges
+__attribute__((target("ssse3")))
+static __m128i nibbles_ssse3(__m128i in, int *valid) {
+  __m128i lower = _mm_or_si128(in, _mm_set1_epi8(0x20));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+  *valid = _mm_movemask_epi8(_mm_or_si128(digit, alpha));
+  return _mm_or_si128(
+    _mm_and_si128(digit, _mm_sub_epi8(in, _mm_set1_epi8('0'))),
+    _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const char *src, size_t len, char *dst) {
+  // hi * 16 + lo for every pair of chars
+  const __m128i weights = _mm_set1_epi16(0x0110);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32, dst += 16) {
+    int valid0, valid1;
+    __m128i v0 = nibbles_ssse3(_mm_loadu_si128((const __m128i *)(src + i)), &valid0);
+    __m128i v1 = nibbles_ssse3(_mm_loadu_si128((const __m128i *)(src + i + 16)), &valid1);
+    if ((valid0 & valid1) != 0xFFFF) {
+      break;
+    }
+    __m128i w0 = _mm_maddubs_epi16(v0, weights);
+    __m128i w1 = _mm_maddubs_epi16(v1, weights);
+    _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(w0, w1));
+  }
+  return i + decode_scalar(src + i, len - i, dst);
+}
+
+__attribute__((target("avx2")))
+static size_t encode_avx2(const char *digits, const unsigned char *src, size_t len, char *dst) {
+  const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)digits));
+  const __m256i nibble = _mm256_set1_epi8(0xF);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32, dst += 64) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble));
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(in, nibble));
+    // the unpacks work per lane, the permutes put the lanes back in order
+    __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  return i + encode_ssse3(digits, src + i, len - i, dst);
+}
+
+__attribute__((target("avx2")))
+static __m256i nibbles_avx2(__m256i in, unsigned *valid) {
+  __m256i lower = _mm256_or_si256(in, _mm256_set1_epi8(0x20));
+  __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+  __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+  *valid = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(digit, alpha));
+  return _mm256_or_si256(
+    _mm256_and_si256(digit, _mm256_sub_epi8(in, _mm256_set1_epi8('0'))),
+    _mm256_and_si256(alpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const char *src, size_t len, char *dst) {
+  const __m256i weights = _mm256_set1_epi16(0x0110);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64, dst += 32) {
+    unsigned valid0, valid1;
+    __m256i v0 = nibbles_avx2(_mm256_loadu_si256((const __m256i *)(src + i)), &valid0);
+    __m256i v1 = nibbles_avx2(_mm256_loadu_si256((const __m256i *)(src + i + 32)), &valid1);
+    if ((valid0 & valid1) != 0xFFFFFFFFu) {
+      break;
+    }
+    __m256i w0 = _mm256_maddubs_epi16(v0, weights);
+    __m256i w1 = _mm256_maddubs_epi16(v1, weights);
+    // packus interleaves the lanes of w0 and w1
+    __m256i out = _mm256_permute4x64_epi64(_mm256_packus_epi16(w0, w1), 0xD8);
+    _mm256_storeu_si256((__m256i *)dst, out);
+  }
+  return i + decode_ssse3(src + i, len - i, dst);
+}
+#endif
+
+static size_t (*hex_encode_block)(const char *digits, const unsigned char *src, size_t len, char *dst) = encode_scalar;
+static size_t (*hex_decode_block)(const char *src, size_t len, char *dst) = decode_scalar;
+
+static int encode_with(lua_State *L, const char *digits) {
+  size_t len;
+  const unsigned char *data = (const unsigned char *)luaL_checklstring(L, 1, &len);
+  luaL_Buffer buf;
+  char *out = luaL_buffinitsize(L, &buf, len * 2);
+  hex_encode_block(digits, data, len, out);
+  luaL_pushresultsize(&buf, len * 2);
+  return 1;
+}
+
+static int l_encoding_hex_encode(lua_State *L) {
+  return encode_with(L, DIGITS_LOWER);
+}
+
+static int l_encoding_hex_encode_upper(lua_State *L) {
+  return encode_with(L, DIGITS_UPPER);
+}
+
+static int l_encoding_hex_decode(lua_State *L) {
+  size_t len;
+  const char *data = luaL_checklstring(L, 1, &len);
+  if (len & 1) {
+    luaL_error(L, "data length is not a multiple of two");
+  }
+  luaL_Buffer buf;
+  char *out = luaL_buffinitsize(L, &buf, len / 2);
+  size_t di = hex_decode_block(data, len, out);
+  if (di != len) {
+    if (decode_map[(unsigned char)data[di]] != INVALID_CHAR) {
+      ++di;
+    }
+    luaL_error(L, ILLEGAL_DATA_ERROR, (int)di);
+  }
+  luaL_pushresultsize(&buf, len / 2);
+  return 1;
+}
+
+static const luaL_Reg encoding_hex_functions[] = {
+  {"Encode", l_encoding_hex_encode},
+  {"EncodeUpper", l_encoding_hex_encode_upper},
+  {"Decode", l_encoding_hex_decode},
+  {NULL, NULL}
+};
+
+static void select_kernels(void) {
+#ifdef HEX_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    hex_encode_block = encode_avx2;
+    hex_decode_block = decode_avx2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    hex_encode_block = encode_ssse3;
+    hex_decode_block = decode_ssse3;
+  }
+#endif
+}
+
+int luaopen_encoding_hex(lua_State *L) {
+  decode_map_init();
+  select_kernels();
+  luaL_newlib(L, encoding_hex_functions);
+  return 1;
+}
@@ -4,6 +4,37 @@
 
 #include <math.h>
 #include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_SIMD_X86
+#endif
+
+#define ENCODING_JSON_INDEX_METATABLE "encoding.json.index"
+#define ENCODING_JSON_DOCUMENT_METATABLE "encoding.json.document"
+#define ENCODING_JSON_DECODER_METATABLE "encoding.json.decoder"
+#define ENCODING_JSON_CODEC_METATABLE "encoding.json.codec"
+#define ENCODING_JSON_LINES_METATABLE "encoding.json.lines"
+#define ENCODING_JSON_MAPPING_METATABLE "encoding.json.mapping"
+#define ENCODING_JSON_ARRAY_METATABLE "encoding.json.array"
+
+// inputs shorter than this are parsed without building a structural index
+#define JSON_INDEX_MIN_SIZE 256
+// the index is built when whitespace runs in the first JSON_INDEX_SAMPLE_SIZE
+// bytes average at least JSON_INDEX_MIN_RUN bytes
+#define JSON_INDEX_SAMPLE_SIZE 4096
+#define JSON_INDEX_MIN_RUN 16
+#define JSON_BLOCK_SIZE 64
 
 #define TOKEN_ERROR "invalid character '%c', require %s"
 #define TOKEN_ERROR_ASCII "invalid character %d(ascii), require %s"
@@ -14,7 +45,403 @@
 // #define json_parse_error(l, c, s) luaL_error(L, isprint(c) ? TOKEN_ERROR_DEBUG : TOKEN_ERROR_DEBUG_ASCII, c, s, __LINE__);
 #define json_parse_error(l, c, s) luaL_error(L, isprint(c) ? TOKEN_ERROR : TOKEN_ERROR_ASCII, c, s);
 
-static const char *skip_whitespace(lua_State *L, const char *p) {
+// Stage 1: classify 64 bytes at a time and record the offset of every
+// structural character, every token start outside of strings and every
+// closing quote. The recursive builder hops from entry to entry over
+// whitespace, takes the length of a string from its closing quote entry
+// instead of scanning the body, and steps over containers by counting
+// brackets in the index. Closing quotes of strings holding an escape, a
+// control or a non-ASCII byte carry JSON_INDEX_SLOW; those strings still
+// go through the byte by byte decoder.
+//
+// Parse still has to read every number and build every value, so on
+// compact input the entries cost about what they save and worth_indexing
+// keeps the index to indented input. Lazy documents step over members on
+// every lookup and always build it.
+
+#define JSON_INDEX_SLOW 0x80000000u
+#define JSON_INDEX_POS 0x7FFFFFFFu
+
+struct json_block {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t whitespace;
+  uint64_t op; // structural characters and NUL
+  uint64_t special; // control and non-ASCII bytes
+};
+
+struct json_index {
+  uint32_t *pos;
+  size_t n;
+  size_t cap;
+};
+
+// Object keys of at most JSON_KEY_MAX_LEN bytes are looked up in a small
+// direct-mapped cache before being pushed, so repeated keys reuse the Lua
+// string held in the anchor table instead of being hashed and interned
+// again. Slots point into the strings they anchor.
+
+#define JSON_KEY_CACHE_BITS 8
+#define JSON_KEY_CACHE_SIZE (1 << JSON_KEY_CACHE_BITS)
+#define JSON_KEY_MAX_LEN 32
+// documents shorter than this are parsed without a key cache
+#define JSON_KEY_CACHE_MIN_SIZE 256
+// depths at which the shape of the previous sibling is remembered
+#define JSON_SHAPE_DEPTH 16
+
+// parse options
+#define JSON_PARSE_TYPED_ARRAYS 1
+
+struct json_key_slot {
+  const char *key;
+  size_t len;
+};
+
+struct json_key_cache {
+  int table; // stack index of the anchor table
+  struct json_key_slot slots[JSON_KEY_CACHE_SIZE];
+};
+
+struct json_parser {
+  const char *data;
+  const char *end;
+  const uint32_t *index; // NULL when parsing without an index
+  size_t cursor;
+  struct json_key_cache *keys; // NULL when keys are not cached
+  size_t depth;
+  int flags; // JSON_PARSE_*
+  int base64_fields; // stack index of the base64 field table, 0 for none
+  // tables are pre-sized like the last object or array at the same depth
+  int object_shape[JSON_SHAPE_DEPTH];
+  int array_shape[JSON_SHAPE_DEPTH];
+};
+
+static void classify_scalar(const char *p, struct json_block *blk) {
+  uint64_t quote = 0, backslash = 0, whitespace = 0, op = 0, special = 0;
+  for (int i = 0; i < JSON_BLOCK_SIZE; ++i) {
+    uint64_t bit = (uint64_t)1 << i;
+    if ((unsigned char)p[i] < 0x20 || (unsigned char)p[i] >= 0x80) {
+      special |= bit;
+    }
+    switch (p[i]) {
+    case '"':
+      quote |= bit;
+      break;
+    case '\\':
+      backslash |= bit;
+      break;
+    case ' ':
+    case '\n':
+    case '\r':
+    case '\t':
+      whitespace |= bit;
+      break;
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+    case '\0':
+      op |= bit;
+      break;
+    }
+  }
+  blk->quote = quote;
+  blk->backslash = backslash;
+  blk->whitespace = whitespace;
+  blk->op = op;
+  blk->special = special;
+}
+
+#ifdef JSON_SIMD_X86
+__attribute__((target("sse2")))
+static void classify_sse2(const char *p, struct json_block *blk) {
+  uint64_t quote = 0, backslash = 0, whitespace = 0, op = 0, special = 0;
+  for (int i = 0; i < JSON_BLOCK_SIZE / 16; ++i) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i * 16));
+    // '[' and ']' differ from '{' and '}' only by 0x20
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+    __m128i ops = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+    ops = _mm_or_si128(ops, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    // the sign bit of v flags non-ASCII bytes
+    __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));
+    int shift = i * 16;
+    quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << shift;
+    backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << shift;
+    whitespace |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << shift;
+    op |= (uint64_t)(uint16_t)_mm_movemask_epi8(ops) << shift;
+    special |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(control, v)) << shift;
+  }
+  blk->quote = quote;
+  blk->backslash = backslash;
+  blk->whitespace = whitespace;
+  blk->op = op;
+  blk->special = special;
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char *p, struct json_block *blk) {
+  uint64_t quote = 0, backslash = 0, whitespace = 0, op = 0, special = 0;
+  for (int i = 0; i < JSON_BLOCK_SIZE / 32; ++i) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i * 32));
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i ws = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+    __m256i ops = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+    ops = _mm256_or_si256(ops, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(0x1F)), _mm256_set1_epi8(0x1F));
+    int shift = i * 32;
+    quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << shift;
+    backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << shift;
+    whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << shift;
+    op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ops) << shift;
+    special |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(control, v)) << shift;
+  }
+  blk->quote = quote;
+  blk->backslash = backslash;
+  blk->whitespace = whitespace;
+  blk->op = op;
+  blk->special = special;
+}
+#endif
+
+static void (*json_classify)(const char *p, struct json_block *blk) = classify_scalar;
+
+static uint64_t prefix_xor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+static int l_encoding_json_index_gc(lua_State *L) {
+  struct json_index *idx = lua_touserdata(L, 1);
+  free(idx->pos);
+  idx->pos = NULL;
+  return 0;
+}
+
+// samples the start of data for long whitespace runs
+static int worth_indexing(const char *data, size_t len) {
+  if (len < JSON_INDEX_MIN_SIZE || len >= JSON_INDEX_SLOW) {
+    return 0;
+  }
+  size_t n = len < JSON_INDEX_SAMPLE_SIZE ? len : JSON_INDEX_SAMPLE_SIZE;
+  size_t whitespace = 0, runs = 0;
+  int in_run = 0;
+  for (size_t i = 0; i < n; ++i) {
+    char c = data[i];
+    int ws = c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    runs += ws && !in_run;
+    whitespace += ws;
+    in_run = ws;
+  }
+  return runs > 0 && whitespace >= runs * JSON_INDEX_MIN_RUN;
+}
+
+// pushes a json_index userdata, the last entry of pos is always len
+static struct json_index *build_index(lua_State *L, const char *data, size_t len) {
+  struct json_index *idx = lua_newuserdata(L, sizeof(*idx));
+  idx->n = 0;
+  idx->cap = len / 4 + JSON_BLOCK_SIZE + 1;
+  idx->pos = malloc(idx->cap * sizeof(uint32_t));
+  luaL_getmetatable(L, ENCODING_JSON_INDEX_METATABLE);
+  lua_setmetatable(L, -2);
+  if (idx->pos == NULL) {
+    luaL_error(L, "failed to allocate structural index");
+  }
+  const uint64_t even_bits = 0x5555555555555555ULL;
+  uint64_t next_escaped = 0;
+  uint64_t prev_in_string = 0;
+  uint64_t prev_scalar = 0;
+  uint64_t prev_clean = 0;
+  struct json_block blk;
+  char tail[JSON_BLOCK_SIZE];
+  for (size_t base = 0; base < len; base += JSON_BLOCK_SIZE) {
+    const char *block = data + base;
+    uint64_t valid = ~(uint64_t)0;
+    if (len - base < JSON_BLOCK_SIZE) {
+      memset(tail, ' ', JSON_BLOCK_SIZE);
+      memcpy(tail, block, len - base);
+      block = tail;
+      valid = ((uint64_t)1 << (len - base)) - 1;
+    }
+    json_classify(block, &blk);
+    // a character is escaped when it follows an odd-length run of backslashes
+    uint64_t escaped;
+    uint64_t backslash = blk.backslash;
+    if (backslash == 0) {
+      escaped = next_escaped;
+      next_escaped = 0;
+    } else {
+      backslash &= ~next_escaped;
+      uint64_t follows_escape = backslash << 1 | next_escaped;
+      uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+      uint64_t even_sequences;
+      next_escaped = __builtin_add_overflow(odd_starts, backslash, &even_sequences);
+      escaped = (even_bits ^ (even_sequences << 1)) & follows_escape;
+    }
+    uint64_t quote = blk.quote & ~escaped;
+    // in_string covers the opening quote and the string body, not the closing quote
+    uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+    prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+    uint64_t scalar = ~(blk.op | blk.whitespace);
+    uint64_t nonquote_scalar = scalar & ~quote;
+    uint64_t follows_scalar = nonquote_scalar << 1 | prev_scalar;
+    prev_scalar = nonquote_scalar >> 63;
+    uint64_t string_tail = in_string ^ quote;
+    uint64_t close = quote & ~in_string;
+    // adding the opening quotes to the clean bytes of the strings carries
+    // through to a closing quote only when no escape, control or non-ASCII
+    // byte stopped it on the way
+    uint64_t clean = in_string & ~(blk.special | blk.backslash);
+    uint64_t carried;
+    uint64_t overflow = __builtin_add_overflow(clean, quote & in_string, &carried);
+    overflow |= __builtin_add_overflow(carried, prev_clean, &carried);
+    prev_clean = overflow;
+    uint64_t slow = close & ~carried;
+    uint64_t structurals = (((blk.op | (scalar & ~follows_scalar)) & ~string_tail) | close) & valid;
+    if (idx->cap - idx->n < JSON_BLOCK_SIZE + 1) {
+      size_t cap = idx->cap * 2;
+      uint32_t *pos = realloc(idx->pos, cap * sizeof(uint32_t));
+      if (pos == NULL) {
+        luaL_error(L, "failed to allocate structural index");
+      }
+      idx->pos = pos;
+      idx->cap = cap;
+    }
+    uint32_t *out = idx->pos + idx->n;
+    for (; structurals; structurals &= structurals - 1) {
+      int i = __builtin_ctzll(structurals);
+      *out++ = (uint32_t)(base + i) | (uint32_t)(slow >> i & 1) << 31;
+    }
+    idx->n = out - idx->pos;
+  }
+  idx->pos[idx->n++] = (uint32_t)len;
+  return idx;
+}
+
+// String runs: the length of the leading stretch of s that can be copied
+// as is, i.e. holds no '"', '\\', control or non-ASCII byte and no byte
+// equal to extra ('/' when stringifying, '"' again when parsing).
+
+static size_t plain_run_scalar(const char *s, size_t len, char extra) {
+  size_t i = 0;
+  for (; i < len; ++i) {
+    unsigned char c = s[i];
+    if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\' || c == (unsigned char)extra) {
+      break;
+    }
+  }
+  return i;
+}
+
+#ifdef JSON_SIMD_X86
+__attribute__((target("sse2")))
+static size_t plain_run_sse2(const char *s, size_t len, char extra) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i other = _mm_set1_epi8(extra);
+  const __m128i control = _mm_set1_epi8(0x1F);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i m = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+      _mm_or_si128(_mm_cmpeq_epi8(v, other), _mm_cmpeq_epi8(_mm_max_epu8(v, control), control)));
+    // the sign bit of v flags non-ASCII bytes
+    unsigned bits = (unsigned)_mm_movemask_epi8(_mm_or_si128(m, v));
+    if (bits != 0) {
+      return i + __builtin_ctz(bits);
+    }
+  }
+  return i + plain_run_scalar(s + i, len - i, extra);
+}
+
+__attribute__((target("avx2")))
+static size_t plain_run_avx2(const char *s, size_t len, char extra) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i other = _mm256_set1_epi8(extra);
+  const __m256i control = _mm256_set1_epi8(0x1F);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+    __m256i m = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, other), _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control)));
+    unsigned bits = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(m, v));
+    if (bits != 0) {
+      return i + __builtin_ctz(bits);
+    }
+  }
+  return i + plain_run_scalar(s + i, len - i, extra);
+}
+#endif
+
+static size_t (*json_plain_run)(const char *s, size_t len, char extra) = plain_run_scalar;
+
+// length of the UTF-8 sequence at the start of s, 0 when it is malformed
+static size_t utf8_sequence(const char *s, size_t len) {
+  unsigned char c = s[0];
+  size_t n;
+  if ((c>>5) == 0x6) {
+    n = 2;
+  } else if ((c>>4) == 0xE) {
+    n = 3;
+  } else if ((c>>3) == 0x1E) {
+    n = 4;
+  } else {
+    return 0;
+  }
+  if (len < n) {
+    return 0;
+  }
+  for (size_t i = 1; i < n; ++i) {
+    if (((unsigned char)s[i]>>6) != 0x2) {
+      return 0;
+    }
+  }
+  return n;
+}
+
+// moves the cursor to the first index entry at or after p
+static size_t index_seek(struct json_parser *jp, const char *p) {
+  uint32_t off = p - jp->data;
+  size_t cursor = jp->cursor;
+  while ((jp->index[cursor] & JSON_INDEX_POS) < off) {
+    ++cursor;
+  }
+  jp->cursor = cursor;
+  return cursor;
+}
+
+static const char *skip_whitespace(lua_State *L, struct json_parser *jp, const char *p) {
+  if (jp->index != NULL) {
+    switch (*p) {
+    case ' ':
+    case '\n':
+    case '\r':
+    case '\t':
+      break;
+    default:
+      return p;
+    }
+    // the first token after a whitespace run is always in the index
+    return jp->data + (jp->index[index_seek(jp, p)] & JSON_INDEX_POS);
+  }
   for (;*p;) {
     switch (*p) {
     case ' ':
@@ -30,321 +457,4031 @@ static const char *skip_whitespace(lua_State *L, const char *p) {
   return p;
 }
 
-static const char *parse_object(lua_State *L, const char *p);
-static const char *parse_array(lua_State *L, const char *p);
-static const char *parse_string(lua_State *L, const char *p);
-static const char *parse_number(lua_State *L, const char *p);
-static const char *parse_true(lua_State *L, const char *p);
-static const char *parse_false(lua_State *L, const char *p);
-static const char *parse_null(lua_State *L, const char *p);
-static const char *parse_value(lua_State *L, const char *p);
-
-static const char *parse_object(lua_State *L, const char *p) {
-  ++p; // '{'
-  lua_newtable(L);
-  p = skip_whitespace(L, p);
-  if (*p == '}') {
-    ++p; // '}'
-    return p;
-  }
-  for (;*p;) {
-    if (*p != '"') {
-      json_parse_error(L, *p, "'\"'");
-    }
-    p = parse_string(L, p);
-    p = skip_whitespace(L, p);
-    if (*p != ':') {
-      json_parse_error(L, *p, "':'");
+// With an index, returns the closing quote of the string opening at p when
+// the string can be pushed as is, and moves the cursor past it; NULL sends
+// the string through the byte by byte decoder.
+static const char *indexed_string_end(struct json_parser *jp, const char *p) {
+  size_t cursor = index_seek(jp, p);
+  uint32_t close = jp->index[cursor + 1];
+  if (jp->index[cursor] != (uint32_t)(p - jp->data) || (close & JSON_INDEX_SLOW) || jp->data[close] != '"') {
+    // out of step with the index, an escaped or unterminated string
+    return NULL;
+  }
+  jp->cursor = cursor + 2;
+  return jp->data + close;
+}
+
+static const char *parse_object(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_array(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_string(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_number(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_true(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_false(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_null(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_value(lua_State *L, struct json_parser *jp, const char *p);
+static const char *parse_typed_array(lua_State *L, struct json_parser *jp, const char *p);
+struct json_base64;
+static const char *parse_base64_string(lua_State *L, struct json_parser *jp, const char *p, const struct json_base64 *b64);
+
+static uint64_t key_hash(const char *key, size_t len) {
+  uint64_t a = 0, b = 0;
+  if (len >= 8) {
+    memcpy(&a, key, 8);
+    memcpy(&b, key + len - 8, 8);
+  } else {
+    memcpy(&a, key, len);
+  }
+  return a * 0x9E3779B97F4A7C15ULL ^ (b + len) * 0xC2B2AE3D27D4EB4FULL;
+}
+
+static const char *parse_key(lua_State *L, struct json_parser *jp, const char *p) {
+  struct json_key_cache *keys = jp->keys;
+  if (keys != NULL) {
+    const char *key = p + 1;
+    const char *e;
+    if (jp->index != NULL) {
+      e = indexed_string_end(jp, p);
+    } else {
+      e = key + json_plain_run(key, jp->end - key, '"');
+      e = *e == '"' ? e : NULL;
+    }
+    if (e != NULL) {
+      size_t len = e - key;
+      if (len > JSON_KEY_MAX_LEN) {
+        lua_pushlstring(L, key, len);
+        return e + 1;
+      }
+      unsigned h = (unsigned)(key_hash(key, len) >> (64 - JSON_KEY_CACHE_BITS));
+      struct json_key_slot *slot = &keys->slots[h];
+      if (slot->key != NULL && slot->len == len && memcmp(slot->key, key, len) == 0) {
+        lua_rawgeti(L, keys->table, h + 1);
+      } else {
+        slot->key = lua_pushlstring(L, key, len);
+        slot->len = len;
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, keys->table, h + 1);
+      }
+      return e + 1;
+    }
+  }
+  return parse_string(L, jp, p);
+}
+
+static const char *parse_object(lua_State *L, struct json_parser *jp, const char *p) {
+  ++p; // '{'
+  size_t depth = jp->depth++;
+  int count = 0;
+  lua_createtable(L, 0, depth < JSON_SHAPE_DEPTH ? jp->object_shape[depth] : 0);
+  p = skip_whitespace(L, jp, p);
+  if (*p != '}') {
+    for (;*p;) {
+      if (*p != '"') {
+        json_parse_error(L, *p, "'\"'");
+      }
+      p = parse_key(L, jp, p);
+      p = skip_whitespace(L, jp, p);
+      if (*p != ':') {
+        json_parse_error(L, *p, "':'");
+      }
+      ++p; // ':'
+      p = skip_whitespace(L, jp, p);
+      const struct json_base64 *b64 = NULL;
+      if (jp->base64_fields != 0 && *p == '"') {
+        lua_pushvalue(L, -1);
+        if (lua_rawget(L, jp->base64_fields) == LUA_TUSERDATA) {
+          b64 = lua_touserdata(L, -1);
+        }
+        lua_pop(L, 1);
+      }
+      p = b64 != NULL ? parse_base64_string(L, jp, p, b64) : parse_value(L, jp, p);
+      p = skip_whitespace(L, jp, p);
+      lua_settable(L, -3);
+      ++count;
+      if (*p != ',') {
+        break;
+      }
+      ++p; // ','
+      p = skip_whitespace(L, jp, p);
+    }
+    if (*p != '}') {
+      json_parse_error(L, *p, "'}' or ','");
+    }
+  }
+  ++p; // '}'
+  if (depth < JSON_SHAPE_DEPTH) {
+    jp->object_shape[depth] = count;
+  }
+  jp->depth = depth;
+  return p;
+}
+
+static const char *parse_array(lua_State *L, struct json_parser *jp, const char *p) {
+  if (jp->flags & JSON_PARSE_TYPED_ARRAYS) {
+    const char *first = skip_whitespace(L, jp, p + 1);
+    if (*first == '-' || (*first >= '0' && *first <= '9')) {
+      const char *e = parse_typed_array(L, jp, p);
+      if (e != NULL) {
+        return e;
+      }
+    }
+  }
+  ++p; // '['
+  size_t depth = jp->depth++;
+  lua_createtable(L, depth < JSON_SHAPE_DEPTH ? jp->array_shape[depth] : 0, 0);
+  p = skip_whitespace(L, jp, p);
+  size_t idx = 1;
+  if (*p != ']') {
+    for (;*p;) {
+      p = parse_value(L, jp, p);
+      p = skip_whitespace(L, jp, p);
+      lua_seti(L, -2, idx++);
+      if (*p != ',') {
+        break;
+      }
+      ++p; // ','
+      p = skip_whitespace(L, jp, p);
+    }
+    if (*p != ']') {
+      json_parse_error(L, *p, "']' or ','");
+    }
+  }
+  ++p; // ']'
+  if (depth < JSON_SHAPE_DEPTH) {
+    jp->array_shape[depth] = (int)(idx - 1);
+  }
+  jp->depth = depth;
+  return p;
+}
+
+// four hex digits, or -1 with *stop at the first bad one
+static int scan_hex4(const char *p, const char **stop) {
+  int code = 0;
+  for (int i = 0; i < 4; ++i) {
+    char c = p[i];
+    char v = 0;
+    if (c >= '0' && c <= '9') {
+      v = c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+      v = c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+      v = c - 'a' + 10;
+    } else {
+      *stop = p + i;
+      return -1;
+    }
+    code <<= 4;
+    code |= v;
+  }
+  return code;
+}
+
+// writes the UTF-8 encoding of code; lone surrogates are kept as three bytes
+static size_t encode_utf8(char *out, unsigned code) {
+  if (code < 0x80) {
+    out[0] = (char)code;
+    return 1;
+  } else if (code < 0x800) {
+    out[0] = (char)((code>>6) | 0xC0);
+    out[1] = (char)((code&0x3F) | 0x80);
+    return 2;
+  } else if (code < 0x10000) {
+    out[0] = (char)((code>>12) | 0xE0);
+    out[1] = (char)(((code>>6) & 0x3F) | 0x80);
+    out[2] = (char)((code&0x3F) | 0x80);
+    return 3;
+  }
+  out[0] = (char)((code>>18) | 0xF0);
+  out[1] = (char)(((code>>12) & 0x3F) | 0x80);
+  out[2] = (char)(((code>>6) & 0x3F) | 0x80);
+  out[3] = (char)((code&0x3F) | 0x80);
+  return 4;
+}
+
+// Decodes the escape at p (pointing at the '\') into out, which has room
+// for four bytes, and returns its length with *stop past the escape. On
+// error returns 0 with *stop at the offending character and *expect set.
+static size_t scan_escape(const char *p, const char **stop, const char **expect, char *out) {
+  ++p; // '\'
+  switch (*p) {
+  case '"':
+  case '\\':
+  case '/':
+    out[0] = *p;
+    break;
+  case 'b':
+    out[0] = '\b';
+    break;
+  case 'f':
+    out[0] = '\f';
+    break;
+  case 'n':
+    out[0] = '\n';
+    break;
+  case 'r':
+    out[0] = '\r';
+    break;
+  case 't':
+    out[0] = '\t';
+    break;
+  case 'u': {
+    ++p; // 'u'
+    int code = scan_hex4(p, stop);
+    if (code < 0) {
+      *expect = "'0'-'9' or 'a'-'f' or 'A'-'F'";
+      return 0;
+    }
+    p += 4;
+    if (code >= 0xD800 && code < 0xDC00 && p[0] == '\\' && p[1] == 'u') {
+      int low = scan_hex4(p + 2, stop);
+      if (low < 0) {
+        *expect = "'0'-'9' or 'a'-'f' or 'A'-'F'";
+        return 0;
+      }
+      if (low >= 0xDC00 && low < 0xE000) {
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        p += 6;
+      }
+    }
+    *stop = p;
+    return encode_utf8(out, (unsigned)code);
+  }
+  default:
+    *stop = p;
+    *expect = "'\"' or '\' or '/' or 'b' or 'f' or 'n' or 'r' or 't' or 'u' hex hex hex hex";
+    return 0;
+  }
+  ++p; // escape
+  *stop = p;
+  return 1;
+}
+
+// p points at the '\'
+static const char *parse_escape(lua_State *L, luaL_Buffer *buf, const char *p) {
+  const char *expect = NULL;
+  size_t n = scan_escape(p, &p, &expect, luaL_prepbuffsize(buf, 4));
+  if (n == 0) {
+    json_parse_error(L, *p, expect);
+  }
+  luaL_addsize(buf, n);
+  return p;
+}
+
+// Clean stretches are found by json_plain_run and copied in one go; strings
+// without escapes are pushed straight from the input.
+static const char *parse_string(lua_State *L, struct json_parser *jp, const char *p) {
+  if (jp->index != NULL) {
+    const char *e = indexed_string_end(jp, p);
+    if (e != NULL) {
+      lua_pushlstring(L, p + 1, e - p - 1);
+      return e + 1;
+    }
+  }
+  ++p; // '"'
+  const char *run = p;
+  p += json_plain_run(p, jp->end - p, '"');
+  if (*p == '"') {
+    lua_pushlstring(L, run, p - run);
+    ++p; // '"'
+    return p;
+  }
+  luaL_Buffer buf;
+  luaL_buffinit(L, &buf);
+  for (;;) {
+    if ((unsigned char)*p >= 0x80) {
+      size_t n = utf8_sequence(p, jp->end - p);
+      if (n == 0) {
+        json_parse_error(L, *p, "U+0020~U+10FFFF");
+      }
+      p += n;
+    } else {
+      luaL_addlstring(&buf, run, p - run);
+      if (*p == '"') {
+        break;
+      } else if (*p == '\\') {
+        p = parse_escape(L, &buf, p);
+      } else if (*p == '\0') {
+        json_parse_error(L, *p, "'\"'");
+      } else {
+        json_parse_error(L, *p, "U+0020~U+10FFFF");
+      }
+      run = p;
+    }
+    p += json_plain_run(p, jp->end - p, '"');
+  }
+  ++p; // '"'
+  luaL_pushresult(&buf);
+  return p;
+}
+
+// Numbers: digits are read eight at a time, then converted with Clinger's
+// exact fast path, the Eisel-Lemire algorithm, or, for the rare inputs
+// where neither is conclusive, exact decimal arithmetic.
+
+enum {
+  NUMBER_ERROR,
+  NUMBER_INTEGER,
+  NUMBER_FLOAT,
+};
+
+#define NUMBER_MAX_DIGITS 768
+#define NUMBER_DECIMAL_POINT_RANGE 2047
+#define NUMBER_SMALLEST_POWER -342
+#define NUMBER_LARGEST_POWER 308
+
+// 128-bit truncated powers of five from 5^-342 to 5^308
+static const uint64_t power_of_five_128[] = {
+  0xeef453d6923bd65aULL, 0x113faa2906a13b3fULL, 0x9558b4661b6565f8ULL, 0x4ac7ca59a424c507ULL,
+  0xbaaee17fa23ebf76ULL, 0x5d79bcf00d2df649ULL, 0xe95a99df8ace6f53ULL, 0xf4d82c2c107973dcULL,
+  0x91d8a02bb6c10594ULL, 0x79071b9b8a4be869ULL, 0xb64ec836a47146f9ULL, 0x9748e2826cdee284ULL,
+  0xe3e27a444d8d98b7ULL, 0xfd1b1b2308169b25ULL, 0x8e6d8c6ab0787f72ULL, 0xfe30f0f5e50e20f7ULL,
+  0xb208ef855c969f4fULL, 0xbdbd2d335e51a935ULL, 0xde8b2b66b3bc4723ULL, 0xad2c788035e61382ULL,
+  0x8b16fb203055ac76ULL, 0x4c3bcb5021afcc31ULL, 0xaddcb9e83c6b1793ULL, 0xdf4abe242a1bbf3dULL,
+  0xd953e8624b85dd78ULL, 0xd71d6dad34a2af0dULL, 0x87d4713d6f33aa6bULL, 0x8672648c40e5ad68ULL,
+  0xa9c98d8ccb009506ULL, 0x680efdaf511f18c2ULL, 0xd43bf0effdc0ba48ULL, 0x0212bd1b2566def2ULL,
+  0x84a57695fe98746dULL, 0x014bb630f7604b57ULL, 0xa5ced43b7e3e9188ULL, 0x419ea3bd35385e2dULL,
+  0xcf42894a5dce35eaULL, 0x52064cac828675b9ULL, 0x818995ce7aa0e1b2ULL, 0x7343efebd1940993ULL,
+  0xa1ebfb4219491a1fULL, 0x1014ebe6c5f90bf8ULL, 0xca66fa129f9b60a6ULL, 0xd41a26e077774ef6ULL,
+  0xfd00b897478238d0ULL, 0x8920b098955522b4ULL, 0x9e20735e8cb16382ULL, 0x55b46e5f5d5535b0ULL,
+  0xc5a890362fddbc62ULL, 0xeb2189f734aa831dULL, 0xf712b443bbd52b7bULL, 0xa5e9ec7501d523e4ULL,
+  0x9a6bb0aa55653b2dULL, 0x47b233c92125366eULL, 0xc1069cd4eabe89f8ULL, 0x999ec0bb696e840aULL,
+  0xf148440a256e2c76ULL, 0xc00670ea43ca250dULL, 0x96cd2a865764dbcaULL, 0x380406926a5e5728ULL,
+  0xbc807527ed3e12bcULL, 0xc605083704f5ecf2ULL, 0xeba09271e88d976bULL, 0xf7864a44c633682eULL,
+  0x93445b8731587ea3ULL, 0x7ab3ee6afbe0211dULL, 0xb8157268fdae9e4cULL, 0x5960ea05bad82964ULL,
+  0xe61acf033d1a45dfULL, 0x6fb92487298e33bdULL, 0x8fd0c16206306babULL, 0xa5d3b6d479f8e056ULL,
+  0xb3c4f1ba87bc8696ULL, 0x8f48a4899877186cULL, 0xe0b62e2929aba83cULL, 0x331acdabfe94de87ULL,
+  0x8c71dcd9ba0b4925ULL, 0x9ff0c08b7f1d0b14ULL, 0xaf8e5410288e1b6fULL, 0x07ecf0ae5ee44dd9ULL,
+  0xdb71e91432b1a24aULL, 0xc9e82cd9f69d6150ULL, 0x892731ac9faf056eULL, 0xbe311c083a225cd2ULL,
+  0xab70fe17c79ac6caULL, 0x6dbd630a48aaf406ULL, 0xd64d3d9db981787dULL, 0x092cbbccdad5b108ULL,
+  0x85f0468293f0eb4eULL, 0x25bbf56008c58ea5ULL, 0xa76c582338ed2621ULL, 0xaf2af2b80af6f24eULL,
+  0xd1476e2c07286faaULL, 0x1af5af660db4aee1ULL, 0x82cca4db847945caULL, 0x50d98d9fc890ed4dULL,
+  0xa37fce126597973cULL, 0xe50ff107bab528a0ULL, 0xcc5fc196fefd7d0cULL, 0x1e53ed49a96272c8ULL,
+  0xff77b1fcbebcdc4fULL, 0x25e8e89c13bb0f7aULL, 0x9faacf3df73609b1ULL, 0x77b191618c54e9acULL,
+  0xc795830d75038c1dULL, 0xd59df5b9ef6a2417ULL, 0xf97ae3d0d2446f25ULL, 0x4b0573286b44ad1dULL,
+  0x9becce62836ac577ULL, 0x4ee367f9430aec32ULL, 0xc2e801fb244576d5ULL, 0x229c41f793cda73fULL,
+  0xf3a20279ed56d48aULL, 0x6b43527578c1110fULL, 0x9845418c345644d6ULL, 0x830a13896b78aaa9ULL,
+  0xbe5691ef416bd60cULL, 0x23cc986bc656d553ULL, 0xedec366b11c6cb8fULL, 0x2cbfbe86b7ec8aa8ULL,
+  0x94b3a202eb1c3f39ULL, 0x7bf7d71432f3d6a9ULL, 0xb9e08a83a5e34f07ULL, 0xdaf5ccd93fb0cc53ULL,
+  0xe858ad248f5c22c9ULL, 0xd1b3400f8f9cff68ULL, 0x91376c36d99995beULL, 0x23100809b9c21fa1ULL,
+  0xb58547448ffffb2dULL, 0xabd40a0c2832a78aULL, 0xe2e69915b3fff9f9ULL, 0x16c90c8f323f516cULL,
+  0x8dd01fad907ffc3bULL, 0xae3da7d97f6792e3ULL, 0xb1442798f49ffb4aULL, 0x99cd11cfdf41779cULL,
+  0xdd95317f31c7fa1dULL, 0x40405643d711d583ULL, 0x8a7d3eef7f1cfc52ULL, 0x482835ea666b2572ULL,
+  0xad1c8eab5ee43b66ULL, 0xda3243650005eecfULL, 0xd863b256369d4a40ULL, 0x90bed43e40076a82ULL,
+  0x873e4f75e2224e68ULL, 0x5a7744a6e804a291ULL, 0xa90de3535aaae202ULL, 0x711515d0a205cb36ULL,
+  0xd3515c2831559a83ULL, 0x0d5a5b44ca873e03ULL, 0x8412d9991ed58091ULL, 0xe858790afe9486c2ULL,
+  0xa5178fff668ae0b6ULL, 0x626e974dbe39a872ULL, 0xce5d73ff402d98e3ULL, 0xfb0a3d212dc8128fULL,
+  0x80fa687f881c7f8eULL, 0x7ce66634bc9d0b99ULL, 0xa139029f6a239f72ULL, 0x1c1fffc1ebc44e80ULL,
+  0xc987434744ac874eULL, 0xa327ffb266b56220ULL, 0xfbe9141915d7a922ULL, 0x4bf1ff9f0062baa8ULL,
+  0x9d71ac8fada6c9b5ULL, 0x6f773fc3603db4a9ULL, 0xc4ce17b399107c22ULL, 0xcb550fb4384d21d3ULL,
+  0xf6019da07f549b2bULL, 0x7e2a53a146606a48ULL, 0x99c102844f94e0fbULL, 0x2eda7444cbfc426dULL,
+  0xc0314325637a1939ULL, 0xfa911155fefb5308ULL, 0xf03d93eebc589f88ULL, 0x793555ab7eba27caULL,
+  0x96267c7535b763b5ULL, 0x4bc1558b2f3458deULL, 0xbbb01b9283253ca2ULL, 0x9eb1aaedfb016f16ULL,
+  0xea9c227723ee8bcbULL, 0x465e15a979c1cadcULL, 0x92a1958a7675175fULL, 0x0bfacd89ec191ec9ULL,
+  0xb749faed14125d36ULL, 0xcef980ec671f667bULL, 0xe51c79a85916f484ULL, 0x82b7e12780e7401aULL,
+  0x8f31cc0937ae58d2ULL, 0xd1b2ecb8b0908810ULL, 0xb2fe3f0b8599ef07ULL, 0x861fa7e6dcb4aa15ULL,
+  0xdfbdcece67006ac9ULL, 0x67a791e093e1d49aULL, 0x8bd6a141006042bdULL, 0xe0c8bb2c5c6d24e0ULL,
+  0xaecc49914078536dULL, 0x58fae9f773886e18ULL, 0xda7f5bf590966848ULL, 0xaf39a475506a899eULL,
+  0x888f99797a5e012dULL, 0x6d8406c952429603ULL, 0xaab37fd7d8f58178ULL, 0xc8e5087ba6d33b83ULL,
+  0xd5605fcdcf32e1d6ULL, 0xfb1e4a9a90880a64ULL, 0x855c3be0a17fcd26ULL, 0x5cf2eea09a55067fULL,
+  0xa6b34ad8c9dfc06fULL, 0xf42faa48c0ea481eULL, 0xd0601d8efc57b08bULL, 0xf13b94daf124da26ULL,
+  0x823c12795db6ce57ULL, 0x76c53d08d6b70858ULL, 0xa2cb1717b52481edULL, 0x54768c4b0c64ca6eULL,
+  0xcb7ddcdda26da268ULL, 0xa9942f5dcf7dfd09ULL, 0xfe5d54150b090b02ULL, 0xd3f93b35435d7c4cULL,
+  0x9efa548d26e5a6e1ULL, 0xc47bc5014a1a6dafULL, 0xc6b8e9b0709f109aULL, 0x359ab6419ca1091bULL,
+  0xf867241c8cc6d4c0ULL, 0xc30163d203c94b62ULL, 0x9b407691d7fc44f8ULL, 0x79e0de63425dcf1dULL,
+  0xc21094364dfb5636ULL, 0x985915fc12f542e4ULL, 0xf294b943e17a2bc4ULL, 0x3e6f5b7b17b2939dULL,
+  0x979cf3ca6cec5b5aULL, 0xa705992ceecf9c42ULL, 0xbd8430bd08277231ULL, 0x50c6ff782a838353ULL,
+  0xece53cec4a314ebdULL, 0xa4f8bf5635246428ULL, 0x940f4613ae5ed136ULL, 0x871b7795e136be99ULL,
+  0xb913179899f68584ULL, 0x28e2557b59846e3fULL, 0xe757dd7ec07426e5ULL, 0x331aeada2fe589cfULL,
+  0x9096ea6f3848984fULL, 0x3ff0d2c85def7621ULL, 0xb4bca50b065abe63ULL, 0x0fed077a756b53a9ULL,
+  0xe1ebce4dc7f16dfbULL, 0xd3e8495912c62894ULL, 0x8d3360f09cf6e4bdULL, 0x64712dd7abbbd95cULL,
+  0xb080392cc4349decULL, 0xbd8d794d96aacfb3ULL, 0xdca04777f541c567ULL, 0xecf0d7a0fc5583a0ULL,
+  0x89e42caaf9491b60ULL, 0xf41686c49db57244ULL, 0xac5d37d5b79b6239ULL, 0x311c2875c522ced5ULL,
+  0xd77485cb25823ac7ULL, 0x7d633293366b828bULL, 0x86a8d39ef77164bcULL, 0xae5dff9c02033197ULL,
+  0xa8530886b54dbdebULL, 0xd9f57f830283fdfcULL, 0xd267caa862a12d66ULL, 0xd072df63c324fd7bULL,
+  0x8380dea93da4bc60ULL, 0x4247cb9e59f71e6dULL, 0xa46116538d0deb78ULL, 0x52d9be85f074e608ULL,
+  0xcd795be870516656ULL, 0x67902e276c921f8bULL, 0x806bd9714632dff6ULL, 0x00ba1cd8a3db53b6ULL,
+  0xa086cfcd97bf97f3ULL, 0x80e8a40eccd228a4ULL, 0xc8a883c0fdaf7df0ULL, 0x6122cd128006b2cdULL,
+  0xfad2a4b13d1b5d6cULL, 0x796b805720085f81ULL, 0x9cc3a6eec6311a63ULL, 0xcbe3303674053bb0ULL,
+  0xc3f490aa77bd60fcULL, 0xbedbfc4411068a9cULL, 0xf4f1b4d515acb93bULL, 0xee92fb5515482d44ULL,
+  0x991711052d8bf3c5ULL, 0x751bdd152d4d1c4aULL, 0xbf5cd54678eef0b6ULL, 0xd262d45a78a0635dULL,
+  0xef340a98172aace4ULL, 0x86fb897116c87c34ULL, 0x9580869f0e7aac0eULL, 0xd45d35e6ae3d4da0ULL,
+  0xbae0a846d2195712ULL, 0x8974836059cca109ULL, 0xe998d258869facd7ULL, 0x2bd1a438703fc94bULL,
+  0x91ff83775423cc06ULL, 0x7b6306a34627ddcfULL, 0xb67f6455292cbf08ULL, 0x1a3bc84c17b1d542ULL,
+  0xe41f3d6a7377eecaULL, 0x20caba5f1d9e4a93ULL, 0x8e938662882af53eULL, 0x547eb47b7282ee9cULL,
+  0xb23867fb2a35b28dULL, 0xe99e619a4f23aa43ULL, 0xdec681f9f4c31f31ULL, 0x6405fa00e2ec94d4ULL,
+  0x8b3c113c38f9f37eULL, 0xde83bc408dd3dd04ULL, 0xae0b158b4738705eULL, 0x9624ab50b148d445ULL,
+  0xd98ddaee19068c76ULL, 0x3badd624dd9b0957ULL, 0x87f8a8d4cfa417c9ULL, 0xe54ca5d70a80e5d6ULL,
+  0xa9f6d30a038d1dbcULL, 0x5e9fcf4ccd211f4cULL, 0xd47487cc8470652bULL, 0x7647c3200069671fULL,
+  0x84c8d4dfd2c63f3bULL, 0x29ecd9f40041e073ULL, 0xa5fb0a17c777cf09ULL, 0xf468107100525890ULL,
+  0xcf79cc9db955c2ccULL, 0x7182148d4066eeb4ULL, 0x81ac1fe293d599bfULL, 0xc6f14cd848405530ULL,
+  0xa21727db38cb002fULL, 0xb8ada00e5a506a7cULL, 0xca9cf1d206fdc03bULL, 0xa6d90811f0e4851cULL,
+  0xfd442e4688bd304aULL, 0x908f4a166d1da663ULL, 0x9e4a9cec15763e2eULL, 0x9a598e4e043287feULL,
+  0xc5dd44271ad3cdbaULL, 0x40eff1e1853f29fdULL, 0xf7549530e188c128ULL, 0xd12bee59e68ef47cULL,
+  0x9a94dd3e8cf578b9ULL, 0x82bb74f8301958ceULL, 0xc13a148e3032d6e7ULL, 0xe36a52363c1faf01ULL,
+  0xf18899b1bc3f8ca1ULL, 0xdc44e6c3cb279ac1ULL, 0x96f5600f15a7b7e5ULL, 0x29ab103a5ef8c0b9ULL,
+  0xbcb2b812db11a5deULL, 0x7415d448f6b6f0e7ULL, 0xebdf661791d60f56ULL, 0x111b495b3464ad21ULL,
+  0x936b9fcebb25c995ULL, 0xcab10dd900beec34ULL, 0xb84687c269ef3bfbULL, 0x3d5d514f40eea742ULL,
+  0xe65829b3046b0afaULL, 0x0cb4a5a3112a5112ULL, 0x8ff71a0fe2c2e6dcULL, 0x47f0e785eaba72abULL,
+  0xb3f4e093db73a093ULL, 0x59ed216765690f56ULL, 0xe0f218b8d25088b8ULL, 0x306869c13ec3532cULL,
+  0x8c974f7383725573ULL, 0x1e414218c73a13fbULL, 0xafbd2350644eeacfULL, 0xe5d1929ef90898faULL,
+  0xdbac6c247d62a583ULL, 0xdf45f746b74abf39ULL, 0x894bc396ce5da772ULL, 0x6b8bba8c328eb783ULL,
+  0xab9eb47c81f5114fULL, 0x066ea92f3f326564ULL, 0xd686619ba27255a2ULL, 0xc80a537b0efefebdULL,
+  0x8613fd0145877585ULL, 0xbd06742ce95f5f36ULL, 0xa798fc4196e952e7ULL, 0x2c48113823b73704ULL,
+  0xd17f3b51fca3a7a0ULL, 0xf75a15862ca504c5ULL, 0x82ef85133de648c4ULL, 0x9a984d73dbe722fbULL,
+  0xa3ab66580d5fdaf5ULL, 0xc13e60d0d2e0ebbaULL, 0xcc963fee10b7d1b3ULL, 0x318df905079926a8ULL,
+  0xffbbcfe994e5c61fULL, 0xfdf17746497f7052ULL, 0x9fd561f1fd0f9bd3ULL, 0xfeb6ea8bedefa633ULL,
+  0xc7caba6e7c5382c8ULL, 0xfe64a52ee96b8fc0ULL, 0xf9bd690a1b68637bULL, 0x3dfdce7aa3c673b0ULL,
+  0x9c1661a651213e2dULL, 0x06bea10ca65c084eULL, 0xc31bfa0fe5698db8ULL, 0x486e494fcff30a62ULL,
+  0xf3e2f893dec3f126ULL, 0x5a89dba3c3efccfaULL, 0x986ddb5c6b3a76b7ULL, 0xf89629465a75e01cULL,
+  0xbe89523386091465ULL, 0xf6bbb397f1135823ULL, 0xee2ba6c0678b597fULL, 0x746aa07ded582e2cULL,
+  0x94db483840b717efULL, 0xa8c2a44eb4571cdcULL, 0xba121a4650e4ddebULL, 0x92f34d62616ce413ULL,
+  0xe896a0d7e51e1566ULL, 0x77b020baf9c81d17ULL, 0x915e2486ef32cd60ULL, 0x0ace1474dc1d122eULL,
+  0xb5b5ada8aaff80b8ULL, 0x0d819992132456baULL, 0xe3231912d5bf60e6ULL, 0x10e1fff697ed6c69ULL,
+  0x8df5efabc5979c8fULL, 0xca8d3ffa1ef463c1ULL, 0xb1736b96b6fd83b3ULL, 0xbd308ff8a6b17cb2ULL,
+  0xddd0467c64bce4a0ULL, 0xac7cb3f6d05ddbdeULL, 0x8aa22c0dbef60ee4ULL, 0x6bcdf07a423aa96bULL,
+  0xad4ab7112eb3929dULL, 0x86c16c98d2c953c6ULL, 0xd89d64d57a607744ULL, 0xe871c7bf077ba8b7ULL,
+  0x87625f056c7c4a8bULL, 0x11471cd764ad4972ULL, 0xa93af6c6c79b5d2dULL, 0xd598e40d3dd89bcfULL,
+  0xd389b47879823479ULL, 0x4aff1d108d4ec2c3ULL, 0x843610cb4bf160cbULL, 0xcedf722a585139baULL,
+  0xa54394fe1eedb8feULL, 0xc2974eb4ee658828ULL, 0xce947a3da6a9273eULL, 0x733d226229feea32ULL,
+  0x811ccc668829b887ULL, 0x0806357d5a3f525fULL, 0xa163ff802a3426a8ULL, 0xca07c2dcb0cf26f7ULL,
+  0xc9bcff6034c13052ULL, 0xfc89b393dd02f0b5ULL, 0xfc2c3f3841f17c67ULL, 0xbbac2078d443ace2ULL,
+  0x9d9ba7832936edc0ULL, 0xd54b944b84aa4c0dULL, 0xc5029163f384a931ULL, 0x0a9e795e65d4df11ULL,
+  0xf64335bcf065d37dULL, 0x4d4617b5ff4a16d5ULL, 0x99ea0196163fa42eULL, 0x504bced1bf8e4e45ULL,
+  0xc06481fb9bcf8d39ULL, 0xe45ec2862f71e1d6ULL, 0xf07da27a82c37088ULL, 0x5d767327bb4e5a4cULL,
+  0x964e858c91ba2655ULL, 0x3a6a07f8d510f86fULL, 0xbbe226efb628afeaULL, 0x890489f70a55368bULL,
+  0xeadab0aba3b2dbe5ULL, 0x2b45ac74ccea842eULL, 0x92c8ae6b464fc96fULL, 0x3b0b8bc90012929dULL,
+  0xb77ada0617e3bbcbULL, 0x09ce6ebb40173744ULL, 0xe55990879ddcaabdULL, 0xcc420a6a101d0515ULL,
+  0x8f57fa54c2a9eab6ULL, 0x9fa946824a12232dULL, 0xb32df8e9f3546564ULL, 0x47939822dc96abf9ULL,
+  0xdff9772470297ebdULL, 0x59787e2b93bc56f7ULL, 0x8bfbea76c619ef36ULL, 0x57eb4edb3c55b65aULL,
+  0xaefae51477a06b03ULL, 0xede622920b6b23f1ULL, 0xdab99e59958885c4ULL, 0xe95fab368e45ecedULL,
+  0x88b402f7fd75539bULL, 0x11dbcb0218ebb414ULL, 0xaae103b5fcd2a881ULL, 0xd652bdc29f26a119ULL,
+  0xd59944a37c0752a2ULL, 0x4be76d3346f0495fULL, 0x857fcae62d8493a5ULL, 0x6f70a4400c562ddbULL,
+  0xa6dfbd9fb8e5b88eULL, 0xcb4ccd500f6bb952ULL, 0xd097ad07a71f26b2ULL, 0x7e2000a41346a7a7ULL,
+  0x825ecc24c873782fULL, 0x8ed400668c0c28c8ULL, 0xa2f67f2dfa90563bULL, 0x728900802f0f32faULL,
+  0xcbb41ef979346bcaULL, 0x4f2b40a03ad2ffb9ULL, 0xfea126b7d78186bcULL, 0xe2f610c84987bfa8ULL,
+  0x9f24b832e6b0f436ULL, 0x0dd9ca7d2df4d7c9ULL, 0xc6ede63fa05d3143ULL, 0x91503d1c79720dbbULL,
+  0xf8a95fcf88747d94ULL, 0x75a44c6397ce912aULL, 0x9b69dbe1b548ce7cULL, 0xc986afbe3ee11abaULL,
+  0xc24452da229b021bULL, 0xfbe85badce996168ULL, 0xf2d56790ab41c2a2ULL, 0xfae27299423fb9c3ULL,
+  0x97c560ba6b0919a5ULL, 0xdccd879fc967d41aULL, 0xbdb6b8e905cb600fULL, 0x5400e987bbc1c920ULL,
+  0xed246723473e3813ULL, 0x290123e9aab23b68ULL, 0x9436c0760c86e30bULL, 0xf9a0b6720aaf6521ULL,
+  0xb94470938fa89bceULL, 0xf808e40e8d5b3e69ULL, 0xe7958cb87392c2c2ULL, 0xb60b1d1230b20e04ULL,
+  0x90bd77f3483bb9b9ULL, 0xb1c6f22b5e6f48c2ULL, 0xb4ecd5f01a4aa828ULL, 0x1e38aeb6360b1af3ULL,
+  0xe2280b6c20dd5232ULL, 0x25c6da63c38de1b0ULL, 0x8d590723948a535fULL, 0x579c487e5a38ad0eULL,
+  0xb0af48ec79ace837ULL, 0x2d835a9df0c6d851ULL, 0xdcdb1b2798182244ULL, 0xf8e431456cf88e65ULL,
+  0x8a08f0f8bf0f156bULL, 0x1b8e9ecb641b58ffULL, 0xac8b2d36eed2dac5ULL, 0xe272467e3d222f3fULL,
+  0xd7adf884aa879177ULL, 0x5b0ed81dcc6abb0fULL, 0x86ccbb52ea94baeaULL, 0x98e947129fc2b4e9ULL,
+  0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL, 0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL,
+  0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL, 0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL,
+  0xcdb02555653131b6ULL, 0x3792f412cb06794dULL, 0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL,
+  0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL, 0xc8de047564d20a8bULL, 0xf245825a5a445275ULL,
+  0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL, 0x9ced737bb6c4183dULL, 0x55464dd69685606bULL,
+  0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL, 0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL,
+  0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL, 0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL,
+  0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL, 0x95a8637627989aadULL, 0xdde7001379a44aa8ULL,
+  0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL, 0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL,
+  0x9226712162ab070dULL, 0xcab3961304ca70e8ULL, 0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL,
+  0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL, 0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL,
+  0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL, 0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL,
+  0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL, 0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL,
+  0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL, 0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL,
+  0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL, 0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL,
+  0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL, 0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL,
+  0xcfb11ead453994baULL, 0x67de18eda5814af2ULL, 0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL,
+  0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL, 0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL,
+  0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL, 0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL,
+  0xc612062576589ddaULL, 0x95364afe032a819eULL, 0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL,
+  0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL, 0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL,
+  0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL, 0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL,
+  0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL, 0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL,
+  0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL, 0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL,
+  0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL, 0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL,
+  0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL, 0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL,
+  0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL, 0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL,
+  0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL, 0x89705f4136b4a597ULL, 0x31680a88f8953031ULL,
+  0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL, 0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL,
+  0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL, 0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL,
+  0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL, 0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL,
+  0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL, 0xccccccccccccccccULL, 0xcccccccccccccccdULL,
+  0x8000000000000000ULL, 0x0000000000000000ULL, 0xa000000000000000ULL, 0x0000000000000000ULL,
+  0xc800000000000000ULL, 0x0000000000000000ULL, 0xfa00000000000000ULL, 0x0000000000000000ULL,
+  0x9c40000000000000ULL, 0x0000000000000000ULL, 0xc350000000000000ULL, 0x0000000000000000ULL,
+  0xf424000000000000ULL, 0x0000000000000000ULL, 0x9896800000000000ULL, 0x0000000000000000ULL,
+  0xbebc200000000000ULL, 0x0000000000000000ULL, 0xee6b280000000000ULL, 0x0000000000000000ULL,
+  0x9502f90000000000ULL, 0x0000000000000000ULL, 0xba43b74000000000ULL, 0x0000000000000000ULL,
+  0xe8d4a51000000000ULL, 0x0000000000000000ULL, 0x9184e72a00000000ULL, 0x0000000000000000ULL,
+  0xb5e620f480000000ULL, 0x0000000000000000ULL, 0xe35fa931a0000000ULL, 0x0000000000000000ULL,
+  0x8e1bc9bf04000000ULL, 0x0000000000000000ULL, 0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL,
+  0xde0b6b3a76400000ULL, 0x0000000000000000ULL, 0x8ac7230489e80000ULL, 0x0000000000000000ULL,
+  0xad78ebc5ac620000ULL, 0x0000000000000000ULL, 0xd8d726b7177a8000ULL, 0x0000000000000000ULL,
+  0x878678326eac9000ULL, 0x0000000000000000ULL, 0xa968163f0a57b400ULL, 0x0000000000000000ULL,
+  0xd3c21bcecceda100ULL, 0x0000000000000000ULL, 0x84595161401484a0ULL, 0x0000000000000000ULL,
+  0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL, 0xcecb8f27f4200f3aULL, 0x0000000000000000ULL,
+  0x813f3978f8940984ULL, 0x4000000000000000ULL, 0xa18f07d736b90be5ULL, 0x5000000000000000ULL,
+  0xc9f2c9cd04674edeULL, 0xa400000000000000ULL, 0xfc6f7c4045812296ULL, 0x4d00000000000000ULL,
+  0x9dc5ada82b70b59dULL, 0xf020000000000000ULL, 0xc5371912364ce305ULL, 0x6c28000000000000ULL,
+  0xf684df56c3e01bc6ULL, 0xc732000000000000ULL, 0x9a130b963a6c115cULL, 0x3c7f400000000000ULL,
+  0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL, 0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL,
+  0x96769950b50d88f4ULL, 0x1314448000000000ULL, 0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL,
+  0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL, 0x92efd1b8d0cf37beULL, 0x5aa1cae500000000ULL,
+  0xb7abc627050305adULL, 0xf14a3d9e40000000ULL, 0xe596b7b0c643c719ULL, 0x6d9ccd05d0000000ULL,
+  0x8f7e32ce7bea5c6fULL, 0xe4820023a2000000ULL, 0xb35dbf821ae4f38bULL, 0xdda2802c8a800000ULL,
+  0xe0352f62a19e306eULL, 0xd50b2037ad200000ULL, 0x8c213d9da502de45ULL, 0x4526f422cc340000ULL,
+  0xaf298d050e4395d6ULL, 0x9670b12b7f410000ULL, 0xdaf3f04651d47b4cULL, 0x3c0cdd765f114000ULL,
+  0x88d8762bf324cd0fULL, 0xa5880a69fb6ac800ULL, 0xab0e93b6efee0053ULL, 0x8eea0d047a457a00ULL,
+  0xd5d238a4abe98068ULL, 0x72a4904598d6d880ULL, 0x85a36366eb71f041ULL, 0x47a6da2b7f864750ULL,
+  0xa70c3c40a64e6c51ULL, 0x999090b65f67d924ULL, 0xd0cf4b50cfe20765ULL, 0xfff4b4e3f741cf6dULL,
+  0x82818f1281ed449fULL, 0xbff8f10e7a8921a4ULL, 0xa321f2d7226895c7ULL, 0xaff72d52192b6a0dULL,
+  0xcbea6f8ceb02bb39ULL, 0x9bf4f8a69f764490ULL, 0xfee50b7025c36a08ULL, 0x02f236d04753d5b4ULL,
+  0x9f4f2726179a2245ULL, 0x01d762422c946590ULL, 0xc722f0ef9d80aad6ULL, 0x424d3ad2b7b97ef5ULL,
+  0xf8ebad2b84e0d58bULL, 0xd2e0898765a7deb2ULL, 0x9b934c3b330c8577ULL, 0x63cc55f49f88eb2fULL,
+  0xc2781f49ffcfa6d5ULL, 0x3cbf6b71c76b25fbULL, 0xf316271c7fc3908aULL, 0x8bef464e3945ef7aULL,
+  0x97edd871cfda3a56ULL, 0x97758bf0e3cbb5acULL, 0xbde94e8e43d0c8ecULL, 0x3d52eeed1cbea317ULL,
+  0xed63a231d4c4fb27ULL, 0x4ca7aaa863ee4bddULL, 0x945e455f24fb1cf8ULL, 0x8fe8caa93e74ef6aULL,
+  0xb975d6b6ee39e436ULL, 0xb3e2fd538e122b44ULL, 0xe7d34c64a9c85d44ULL, 0x60dbbca87196b616ULL,
+  0x90e40fbeea1d3a4aULL, 0xbc8955e946fe31cdULL, 0xb51d13aea4a488ddULL, 0x6babab6398bdbe41ULL,
+  0xe264589a4dcdab14ULL, 0xc696963c7eed2dd1ULL, 0x8d7eb76070a08aecULL, 0xfc1e1de5cf543ca2ULL,
+  0xb0de65388cc8ada8ULL, 0x3b25a55f43294bcbULL, 0xdd15fe86affad912ULL, 0x49ef0eb713f39ebeULL,
+  0x8a2dbf142dfcc7abULL, 0x6e3569326c784337ULL, 0xacb92ed9397bf996ULL, 0x49c2c37f07965404ULL,
+  0xd7e77a8f87daf7fbULL, 0xdc33745ec97be906ULL, 0x86f0ac99b4e8dafdULL, 0x69a028bb3ded71a3ULL,
+  0xa8acd7c0222311bcULL, 0xc40832ea0d68ce0cULL, 0xd2d80db02aabd62bULL, 0xf50a3fa490c30190ULL,
+  0x83c7088e1aab65dbULL, 0x792667c6da79e0faULL, 0xa4b8cab1a1563f52ULL, 0x577001b891185938ULL,
+  0xcde6fd5e09abcf26ULL, 0xed4c0226b55e6f86ULL, 0x80b05e5ac60b6178ULL, 0x544f8158315b05b4ULL,
+  0xa0dc75f1778e39d6ULL, 0x696361ae3db1c721ULL, 0xc913936dd571c84cULL, 0x03bc3a19cd1e38e9ULL,
+  0xfb5878494ace3a5fULL, 0x04ab48a04065c723ULL, 0x9d174b2dcec0e47bULL, 0x62eb0d64283f9c76ULL,
+  0xc45d1df942711d9aULL, 0x3ba5d0bd324f8394ULL, 0xf5746577930d6500ULL, 0xca8f44ec7ee36479ULL,
+  0x9968bf6abbe85f20ULL, 0x7e998b13cf4e1ecbULL, 0xbfc2ef456ae276e8ULL, 0x9e3fedd8c321a67eULL,
+  0xefb3ab16c59b14a2ULL, 0xc5cfe94ef3ea101eULL, 0x95d04aee3b80ece5ULL, 0xbba1f1d158724a12ULL,
+  0xbb445da9ca61281fULL, 0x2a8a6e45ae8edc97ULL, 0xea1575143cf97226ULL, 0xf52d09d71a3293bdULL,
+  0x924d692ca61be758ULL, 0x593c2626705f9c56ULL, 0xb6e0c377cfa2e12eULL, 0x6f8b2fb00c77836cULL,
+  0xe498f455c38b997aULL, 0x0b6dfb9c0f956447ULL, 0x8edf98b59a373fecULL, 0x4724bd4189bd5eacULL,
+  0xb2977ee300c50fe7ULL, 0x58edec91ec2cb657ULL, 0xdf3d5e9bc0f653e1ULL, 0x2f2967b66737e3edULL,
+  0x8b865b215899f46cULL, 0xbd79e0d20082ee74ULL, 0xae67f1e9aec07187ULL, 0xecd8590680a3aa11ULL,
+  0xda01ee641a708de9ULL, 0xe80e6f4820cc9495ULL, 0x884134fe908658b2ULL, 0x3109058d147fdcddULL,
+  0xaa51823e34a7eedeULL, 0xbd4b46f0599fd415ULL, 0xd4e5e2cdc1d1ea96ULL, 0x6c9e18ac7007c91aULL,
+  0x850fadc09923329eULL, 0x03e2cf6bc604ddb0ULL, 0xa6539930bf6bff45ULL, 0x84db8346b786151cULL,
+  0xcfe87f7cef46ff16ULL, 0xe612641865679a63ULL, 0x81f14fae158c5f6eULL, 0x4fcb7e8f3f60c07eULL,
+  0xa26da3999aef7749ULL, 0xe3be5e330f38f09dULL, 0xcb090c8001ab551cULL, 0x5cadf5bfd3072cc5ULL,
+  0xfdcb4fa002162a63ULL, 0x73d9732fc7c8f7f6ULL, 0x9e9f11c4014dda7eULL, 0x2867e7fddcdd9afaULL,
+  0xc646d63501a1511dULL, 0xb281e1fd541501b8ULL, 0xf7d88bc24209a565ULL, 0x1f225a7ca91a4226ULL,
+  0x9ae757596946075fULL, 0x3375788de9b06958ULL, 0xc1a12d2fc3978937ULL, 0x0052d6b1641c83aeULL,
+  0xf209787bb47d6b84ULL, 0xc0678c5dbd23a49aULL, 0x9745eb4d50ce6332ULL, 0xf840b7ba963646e0ULL,
+  0xbd176620a501fbffULL, 0xb650e5a93bc3d898ULL, 0xec5d3fa8ce427affULL, 0xa3e51f138ab4cebeULL,
+  0x93ba47c980e98cdfULL, 0xc66f336c36b10137ULL, 0xb8a8d9bbe123f017ULL, 0xb80b0047445d4184ULL,
+  0xe6d3102ad96cec1dULL, 0xa60dc059157491e5ULL, 0x9043ea1ac7e41392ULL, 0x87c89837ad68db2fULL,
+  0xb454e4a179dd1877ULL, 0x29babe4598c311fbULL, 0xe16a1dc9d8545e94ULL, 0xf4296dd6fef3d67aULL,
+  0x8ce2529e2734bb1dULL, 0x1899e4a65f58660cULL, 0xb01ae745b101e9e4ULL, 0x5ec05dcff72e7f8fULL,
+  0xdc21a1171d42645dULL, 0x76707543f4fa1f73ULL, 0x899504ae72497ebaULL, 0x6a06494a791c53a8ULL,
+  0xabfa45da0edbde69ULL, 0x0487db9d17636892ULL, 0xd6f8d7509292d603ULL, 0x45a9d2845d3c42b6ULL,
+  0x865b86925b9bc5c2ULL, 0x0b8a2392ba45a9b2ULL, 0xa7f26836f282b732ULL, 0x8e6cac7768d7141eULL,
+  0xd1ef0244af2364ffULL, 0x3207d795430cd926ULL, 0x8335616aed761f1fULL, 0x7f44e6bd49e807b8ULL,
+  0xa402b9c5a8d3a6e7ULL, 0x5f16206c9c6209a6ULL, 0xcd036837130890a1ULL, 0x36dba887c37a8c0fULL,
+  0x802221226be55a64ULL, 0xc2494954da2c9789ULL, 0xa02aa96b06deb0fdULL, 0xf2db9baa10b7bd6cULL,
+  0xc83553c5c8965d3dULL, 0x6f92829494e5acc7ULL, 0xfa42a8b73abbf48cULL, 0xcb772339ba1f17f9ULL,
+  0x9c69a97284b578d7ULL, 0xff2a760414536efbULL, 0xc38413cf25e2d70dULL, 0xfef5138519684abaULL,
+  0xf46518c2ef5b8cd1ULL, 0x7eb258665fc25d69ULL, 0x98bf2f79d5993802ULL, 0xef2f773ffbd97a61ULL,
+  0xbeeefb584aff8603ULL, 0xaafb550ffacfd8faULL, 0xeeaaba2e5dbf6784ULL, 0x95ba2a53f983cf38ULL,
+  0x952ab45cfa97a0b2ULL, 0xdd945a747bf26183ULL, 0xba756174393d88dfULL, 0x94f971119aeef9e4ULL,
+  0xe912b9d1478ceb17ULL, 0x7a37cd5601aab85dULL, 0x91abb422ccb812eeULL, 0xac62e055c10ab33aULL,
+  0xb616a12b7fe617aaULL, 0x577b986b314d6009ULL, 0xe39c49765fdf9d94ULL, 0xed5a7e85fda0b80bULL,
+  0x8e41ade9fbebc27dULL, 0x14588f13be847307ULL, 0xb1d219647ae6b31cULL, 0x596eb2d8ae258fc8ULL,
+  0xde469fbd99a05fe3ULL, 0x6fca5f8ed9aef3bbULL, 0x8aec23d680043beeULL, 0x25de7bb9480d5854ULL,
+  0xada72ccc20054ae9ULL, 0xaf561aa79a10ae6aULL, 0xd910f7ff28069da4ULL, 0x1b2ba1518094da04ULL,
+  0x87aa9aff79042286ULL, 0x90fb44d2f05d0842ULL, 0xa99541bf57452b28ULL, 0x353a1607ac744a53ULL,
+  0xd3fa922f2d1675f2ULL, 0x42889b8997915ce8ULL, 0x847c9b5d7c2e09b7ULL, 0x69956135febada11ULL,
+  0xa59bc234db398c25ULL, 0x43fab9837e699095ULL, 0xcf02b2c21207ef2eULL, 0x94f967e45e03f4bbULL,
+  0x8161afb94b44f57dULL, 0x1d1be0eebac278f5ULL, 0xa1ba1ba79e1632dcULL, 0x6462d92a69731732ULL,
+  0xca28a291859bbf93ULL, 0x7d7b8f7503cfdcfeULL, 0xfcb2cb35e702af78ULL, 0x5cda735244c3d43eULL,
+  0x9defbf01b061adabULL, 0x3a0888136afa64a7ULL, 0xc56baec21c7a1916ULL, 0x088aaa1845b8fdd0ULL,
+  0xf6c69a72a3989f5bULL, 0x8aad549e57273d45ULL, 0x9a3c2087a63f6399ULL, 0x36ac54e2f678864bULL,
+  0xc0cb28a98fcf3c7fULL, 0x84576a1bb416a7ddULL, 0xf0fdf2d3f3c30b9fULL, 0x656d44a2a11c51d5ULL,
+  0x969eb7c47859e743ULL, 0x9f644ae5a4b1b325ULL, 0xbc4665b596706114ULL, 0x873d5d9f0dde1feeULL,
+  0xeb57ff22fc0c7959ULL, 0xa90cb506d155a7eaULL, 0x9316ff75dd87cbd8ULL, 0x09a7f12442d588f2ULL,
+  0xb7dcbf5354e9beceULL, 0x0c11ed6d538aeb2fULL, 0xe5d3ef282a242e81ULL, 0x8f1668c8a86da5faULL,
+  0x8fa475791a569d10ULL, 0xf96e017d694487bcULL, 0xb38d92d760ec4455ULL, 0x37c981dcc395a9acULL,
+  0xe070f78d3927556aULL, 0x85bbe253f47b1417ULL, 0x8c469ab843b89562ULL, 0x93956d7478ccec8eULL,
+  0xaf58416654a6babbULL, 0x387ac8d1970027b2ULL, 0xdb2e51bfe9d0696aULL, 0x06997b05fcc0319eULL,
+  0x88fcf317f22241e2ULL, 0x441fece3bdf81f03ULL, 0xab3c2fddeeaad25aULL, 0xd527e81cad7626c3ULL,
+  0xd60b3bd56a5586f1ULL, 0x8a71e223d8d3b074ULL, 0x85c7056562757456ULL, 0xf6872d5667844e49ULL,
+  0xa738c6bebb12d16cULL, 0xb428f8ac016561dbULL, 0xd106f86e69d785c7ULL, 0xe13336d701beba52ULL,
+  0x82a45b450226b39cULL, 0xecc0024661173473ULL, 0xa34d721642b06084ULL, 0x27f002d7f95d0190ULL,
+  0xcc20ce9bd35c78a5ULL, 0x31ec038df7b441f4ULL, 0xff290242c83396ceULL, 0x7e67047175a15271ULL,
+  0x9f79a169bd203e41ULL, 0x0f0062c6e984d386ULL, 0xc75809c42c684dd1ULL, 0x52c07b78a3e60868ULL,
+  0xf92e0c3537826145ULL, 0xa7709a56ccdf8a82ULL, 0x9bbcc7a142b17ccbULL, 0x88a66076400bb691ULL,
+  0xc2abf989935ddbfeULL, 0x6acff893d00ea435ULL, 0xf356f7ebf83552feULL, 0x0583f6b8c4124d43ULL,
+  0x98165af37b2153deULL, 0xc3727a337a8b704aULL, 0xbe1bf1b059e9a8d6ULL, 0x744f18c0592e4c5cULL,
+  0xeda2ee1c7064130cULL, 0x1162def06f79df73ULL, 0x9485d4d1c63e8be7ULL, 0x8addcb5645ac2ba8ULL,
+  0xb9a74a0637ce2ee1ULL, 0x6d953e2bd7173692ULL, 0xe8111c87c5c1ba99ULL, 0xc8fa8db6ccdd0437ULL,
+  0x910ab1d4db9914a0ULL, 0x1d9c9892400a22a2ULL, 0xb54d5e4a127f59c8ULL, 0x2503beb6d00cab4bULL,
+  0xe2a0b5dc971f303aULL, 0x2e44ae64840fd61dULL, 0x8da471a9de737e24ULL, 0x5ceaecfed289e5d2ULL,
+  0xb10d8e1456105dadULL, 0x7425a83e872c5f47ULL, 0xdd50f1996b947518ULL, 0xd12f124e28f77719ULL,
+  0x8a5296ffe33cc92fULL, 0x82bd6b70d99aaa6fULL, 0xace73cbfdc0bfb7bULL, 0x636cc64d1001550bULL,
+  0xd8210befd30efa5aULL, 0x3c47f7e05401aa4eULL, 0x8714a775e3e95c78ULL, 0x65acfaec34810a71ULL,
+  0xa8d9d1535ce3b396ULL, 0x7f1839a741a14d0dULL, 0xd31045a8341ca07cULL, 0x1ede48111209a050ULL,
+  0x83ea2b892091e44dULL, 0x934aed0aab460432ULL, 0xa4e4b66b68b65d60ULL, 0xf81da84d5617853fULL,
+  0xce1de40642e3f4b9ULL, 0x36251260ab9d668eULL, 0x80d2ae83e9ce78f3ULL, 0xc1d72b7c6b426019ULL,
+  0xa1075a24e4421730ULL, 0xb24cf65b8612f81fULL, 0xc94930ae1d529cfcULL, 0xdee033f26797b627ULL,
+  0xfb9b7cd9a4a7443cULL, 0x169840ef017da3b1ULL, 0x9d412e0806e88aa5ULL, 0x8e1f289560ee864eULL,
+  0xc491798a08a2ad4eULL, 0xf1a6f2bab92a27e2ULL, 0xf5b5d7ec8acb58a2ULL, 0xae10af696774b1dbULL,
+  0x9991a6f3d6bf1765ULL, 0xacca6da1e0a8ef29ULL, 0xbff610b0cc6edd3fULL, 0x17fd090a58d32af3ULL,
+  0xeff394dcff8a948eULL, 0xddfc4b4cef07f5b0ULL, 0x95f83d0a1fb69cd9ULL, 0x4abdaf101564f98eULL,
+  0xbb764c4ca7a4440fULL, 0x9d6d1ad41abe37f1ULL, 0xea53df5fd18d5513ULL, 0x84c86189216dc5edULL,
+  0x92746b9be2f8552cULL, 0x32fd3cf5b4e49bb4ULL, 0xb7118682dbb66a77ULL, 0x3fbc8c33221dc2a1ULL,
+  0xe4d5e82392a40515ULL, 0x0fabaf3feaa5334aULL, 0x8f05b1163ba6832dULL, 0x29cb4d87f2a7400eULL,
+  0xb2c71d5bca9023f8ULL, 0x743e20e9ef511012ULL, 0xdf78e4b2bd342cf6ULL, 0x914da9246b255416ULL,
+  0x8bab8eefb6409c1aULL, 0x1ad089b6c2f7548eULL, 0xae9672aba3d0c320ULL, 0xa184ac2473b529b1ULL,
+  0xda3c0f568cc4f3e8ULL, 0xc9e5d72d90a2741eULL, 0x8865899617fb1871ULL, 0x7e2fa67c7a658892ULL,
+  0xaa7eebfb9df9de8dULL, 0xddbb901b98feeab7ULL, 0xd51ea6fa85785631ULL, 0x552a74227f3ea565ULL,
+  0x8533285c936b35deULL, 0xd53a88958f87275fULL, 0xa67ff273b8460356ULL, 0x8a892abaf368f137ULL,
+  0xd01fef10a657842cULL, 0x2d2b7569b0432d85ULL, 0x8213f56a67f6b29bULL, 0x9c3b29620e29fc73ULL,
+  0xa298f2c501f45f42ULL, 0x8349f3ba91b47b8fULL, 0xcb3f2f7642717713ULL, 0x241c70a936219a73ULL,
+  0xfe0efb53d30dd4d7ULL, 0xed238cd383aa0110ULL, 0x9ec95d1463e8a506ULL, 0xf4363804324a40aaULL,
+  0xc67bb4597ce2ce48ULL, 0xb143c6053edcd0d5ULL, 0xf81aa16fdc1b81daULL, 0xdd94b7868e94050aULL,
+  0x9b10a4e5e9913128ULL, 0xca7cf2b4191c8326ULL, 0xc1d4ce1f63f57d72ULL, 0xfd1c2f611f63a3f0ULL,
+  0xf24a01a73cf2dccfULL, 0xbc633b39673c8cecULL, 0x976e41088617ca01ULL, 0xd5be0503e085d813ULL,
+  0xbd49d14aa79dbc82ULL, 0x4b2d8644d8a74e18ULL, 0xec9c459d51852ba2ULL, 0xddf8e7d60ed1219eULL,
+  0x93e1ab8252f33b45ULL, 0xcabb90e5c942b503ULL, 0xb8da1662e7b00a17ULL, 0x3d6a751f3b936243ULL,
+  0xe7109bfba19c0c9dULL, 0x0cc512670a783ad4ULL, 0x906a617d450187e2ULL, 0x27fb2b80668b24c5ULL,
+  0xb484f9dc9641e9daULL, 0xb1f9f660802dedf6ULL, 0xe1a63853bbd26451ULL, 0x5e7873f8a0396973ULL,
+  0x8d07e33455637eb2ULL, 0xdb0b487b6423e1e8ULL, 0xb049dc016abc5e5fULL, 0x91ce1a9a3d2cda62ULL,
+  0xdc5c5301c56b75f7ULL, 0x7641a140cc7810fbULL, 0x89b9b3e11b6329baULL, 0xa9e904c87fcb0a9dULL,
+  0xac2820d9623bf429ULL, 0x546345fa9fbdcd44ULL, 0xd732290fbacaf133ULL, 0xa97c177947ad4095ULL,
+  0x867f59a9d4bed6c0ULL, 0x49ed8eabcccc485dULL, 0xa81f301449ee8c70ULL, 0x5c68f256bfff5a74ULL,
+  0xd226fc195c6a2f8cULL, 0x73832eec6fff3111ULL, 0x83585d8fd9c25db7ULL, 0xc831fd53c5ff7eabULL,
+  0xa42e74f3d032f525ULL, 0xba3e7ca8b77f5e55ULL, 0xcd3a1230c43fb26fULL, 0x28ce1bd2e55f35ebULL,
+  0x80444b5e7aa7cf85ULL, 0x7980d163cf5b81b3ULL, 0xa0555e361951c366ULL, 0xd7e105bcc332621fULL,
+  0xc86ab5c39fa63440ULL, 0x8dd9472bf3fefaa7ULL, 0xfa856334878fc150ULL, 0xb14f98f6f0feb951ULL,
+  0x9c935e00d4b9d8d2ULL, 0x6ed1bf9a569f33d3ULL, 0xc3b8358109e84f07ULL, 0x0a862f80ec4700c8ULL,
+  0xf4a642e14c6262c8ULL, 0xcd27bb612758c0faULL, 0x98e7e9cccfbd7dbdULL, 0x8038d51cb897789cULL,
+  0xbf21e44003acdd2cULL, 0xe0470a63e6bd56c3ULL, 0xeeea5d5004981478ULL, 0x1858ccfce06cac74ULL,
+  0x95527a5202df0ccbULL, 0x0f37801e0c43ebc8ULL, 0xbaa718e68396cffdULL, 0xd30560258f54e6baULL,
+  0xe950df20247c83fdULL, 0x47c6b82ef32a2069ULL, 0x91d28b7416cdd27eULL, 0x4cdc331d57fa5441ULL,
+  0xb6472e511c81471dULL, 0xe0133fe4adf8e952ULL, 0xe3d8f9e563a198e5ULL, 0x58180fddd97723a6ULL,
+  0x8e679c2f5e44ff8fULL, 0x570f09eaa7ea7648ULL,
+};
+
+static const double exact_power_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static int is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static uint64_t load_eight(const char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static int is_eight_digits(uint64_t v) {
+  return ((v + 0x4646464646464646ULL) | (v - 0x3030303030303030ULL)) & 0x8080808080808080ULL ? 0 : 1;
+}
+
+static uint32_t parse_eight_digits(uint64_t v) {
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+       (((v >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+  return (uint32_t)v;
+}
+
+static const char *scan_digits(const char *p, const char *end, uint64_t *w) {
+  uint64_t v = *w;
+  for (; end - p >= 8 && is_eight_digits(load_eight(p)); p += 8) {
+    v = v * 100000000 + parse_eight_digits(load_eight(p));
+  }
+  for (; p < end && is_digit(*p); ++p) {
+    v = v * 10 + (*p - '0');
+  }
+  *w = v;
+  return p;
+}
+
+struct binary_float {
+  uint64_t mantissa;
+  int32_t power2; // biased exponent, negative when the result is undecided
+};
+
+static void full_multiplication(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo) {
+  unsigned __int128 r = (unsigned __int128)a * b;
+  *hi = (uint64_t)(r >> 64);
+  *lo = (uint64_t)r;
+}
+
+// w * 10^q for a non-zero w
+static struct binary_float eisel_lemire(int64_t q, uint64_t w) {
+  struct binary_float answer = {0, 0};
+  if (w == 0 || q < NUMBER_SMALLEST_POWER) {
+    return answer;
+  }
+  if (q > NUMBER_LARGEST_POWER) {
+    answer.power2 = 0x7FF;
+    return answer;
+  }
+  int lz = __builtin_clzll(w);
+  w <<= lz;
+  int index = 2 * (int)(q - NUMBER_SMALLEST_POWER);
+  uint64_t hi, lo;
+  full_multiplication(w, power_of_five_128[index], &hi, &lo);
+  const uint64_t precision_mask = 0xFFFFFFFFFFFFFFFFULL >> 55;
+  if ((hi & precision_mask) == precision_mask) {
+    uint64_t hi2, lo2;
+    full_multiplication(w, power_of_five_128[index + 1], &hi2, &lo2);
+    lo += hi2;
+    if (hi2 > lo) {
+      ++hi;
+    }
+    if (lo == 0xFFFFFFFFFFFFFFFFULL && (q < -27 || q > 55)) {
+      answer.power2 = -1;
+      return answer;
+    }
+  }
+  int upperbit = (int)(hi >> 63);
+  answer.mantissa = hi >> (upperbit + 9);
+  answer.power2 = (int32_t)(((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + 1023;
+  if (answer.power2 <= 0) {
+    // subnormal
+    if (-answer.power2 + 1 >= 64) {
+      answer.mantissa = 0;
+      answer.power2 = 0;
+      return answer;
+    }
+    answer.mantissa >>= -answer.power2 + 1;
+    answer.mantissa += answer.mantissa & 1;
+    answer.mantissa >>= 1;
+    answer.power2 = answer.mantissa < ((uint64_t)1 << 52) ? 0 : 1;
+    return answer;
+  }
+  if (lo <= 1 && q >= -4 && q <= 23 && (answer.mantissa & 3) == 1) {
+    // exactly halfway between two floats, round to even
+    if ((answer.mantissa << (upperbit + 9)) == hi) {
+      answer.mantissa &= ~(uint64_t)1;
+    }
+  }
+  answer.mantissa += answer.mantissa & 1;
+  answer.mantissa >>= 1;
+  if (answer.mantissa >= ((uint64_t)2 << 52)) {
+    answer.mantissa = (uint64_t)1 << 52;
+    ++answer.power2;
+  }
+  answer.mantissa &= ~((uint64_t)1 << 52);
+  if (answer.power2 >= 0x7FF) {
+    answer.power2 = 0x7FF;
+    answer.mantissa = 0;
+  }
+  return answer;
+}
+
+struct big_decimal {
+  uint32_t num_digits;
+  int32_t decimal_point;
+  int truncated;
+  uint8_t digits[NUMBER_MAX_DIGITS];
+};
+
+static void big_decimal_trim(struct big_decimal *d) {
+  for (; d->num_digits > 0 && d->digits[d->num_digits - 1] == 0; --d->num_digits);
+}
+
+static void big_decimal_right_shift(struct big_decimal *d, uint32_t shift) {
+  uint32_t read = 0, write = 0;
+  uint64_t n = 0;
+  while ((n >> shift) == 0) {
+    if (read < d->num_digits) {
+      n = 10 * n + d->digits[read++];
+    } else if (n == 0) {
+      return;
+    } else {
+      while ((n >> shift) == 0) {
+        n = 10 * n;
+        ++read;
+      }
+      break;
+    }
+  }
+  d->decimal_point -= (int32_t)read - 1;
+  if (d->decimal_point < -NUMBER_DECIMAL_POINT_RANGE) {
+    d->num_digits = 0;
+    d->decimal_point = 0;
+    d->truncated = 0;
+    return;
+  }
+  uint64_t mask = ((uint64_t)1 << shift) - 1;
+  while (read < d->num_digits) {
+    uint8_t digit = (uint8_t)(n >> shift);
+    n = 10 * (n & mask) + d->digits[read++];
+    d->digits[write++] = digit;
+  }
+  while (n > 0) {
+    uint8_t digit = (uint8_t)(n >> shift);
+    n = 10 * (n & mask);
+    if (write < NUMBER_MAX_DIGITS) {
+      d->digits[write++] = digit;
+    } else if (digit > 0) {
+      d->truncated = 1;
+    }
+  }
+  d->num_digits = write;
+  big_decimal_trim(d);
+}
+
+static void big_decimal_left_shift(struct big_decimal *d, uint32_t shift) {
+  if (d->num_digits == 0) {
+    return;
+  }
+  // the carry stays below 2^60, so it adds at most 19 digits
+  uint8_t tmp[NUMBER_MAX_DIGITS + 19];
+  uint32_t out = d->num_digits + 19;
+  uint32_t last = out;
+  uint64_t carry = 0;
+  for (uint32_t i = d->num_digits; i-- > 0;) {
+    uint64_t n = ((uint64_t)d->digits[i] << shift) + carry;
+    tmp[--out] = (uint8_t)(n % 10);
+    carry = n / 10;
+  }
+  for (; carry > 0; carry /= 10) {
+    tmp[--out] = (uint8_t)(carry % 10);
+  }
+  uint32_t count = last - out;
+  d->decimal_point += (int32_t)(count - d->num_digits);
+  if (count > NUMBER_MAX_DIGITS) {
+    for (uint32_t i = NUMBER_MAX_DIGITS; i < count; ++i) {
+      if (tmp[out + i] != 0) {
+        d->truncated = 1;
+      }
+    }
+    count = NUMBER_MAX_DIGITS;
+  }
+  memcpy(d->digits, tmp + out, count);
+  d->num_digits = count;
+  big_decimal_trim(d);
+}
+
+static uint64_t big_decimal_round(struct big_decimal *d) {
+  if (d->num_digits == 0 || d->decimal_point < 0) {
+    return 0;
+  } else if (d->decimal_point > 18) {
+    return UINT64_MAX;
+  }
+  uint32_t dp = (uint32_t)d->decimal_point;
+  uint64_t n = 0;
+  for (uint32_t i = 0; i < dp; ++i) {
+    n = 10 * n + (i < d->num_digits ? d->digits[i] : 0);
+  }
+  int round_up = 0;
+  if (dp < d->num_digits) {
+    round_up = d->digits[dp] >= 5;
+    if (d->digits[dp] == 5 && dp + 1 == d->num_digits) {
+      round_up = d->truncated || (dp > 0 && (d->digits[dp - 1] & 1));
+    }
+  }
+  return n + round_up;
+}
+
+// digits of the mantissa, a '.' may appear among them
+static struct binary_float big_decimal_to_binary(const char *p, const char *end, int64_t exponent) {
+  static const uint8_t powers[] = {
+    0, 3, 6, 9, 13, 16, 19, 23, 26, 29, 33, 36, 39, 43, 46, 49, 53, 56, 59,
+  };
+  const uint32_t num_powers = sizeof(powers) / sizeof(powers[0]);
+  const uint32_t max_shift = 60;
+  struct binary_float answer = {0, 0};
+  struct big_decimal d;
+  d.num_digits = 0;
+  d.decimal_point = 0;
+  d.truncated = 0;
+  int seen_point = 0;
+  int64_t point = 0;
+  for (; p < end; ++p) {
+    if (*p == '.') {
+      seen_point = 1;
+      continue;
+    }
+    if (d.num_digits == 0 && *p == '0') {
+      // leading zeros only move the decimal point
+      point -= seen_point;
+      continue;
+    }
+    if (d.num_digits < NUMBER_MAX_DIGITS) {
+      d.digits[d.num_digits] = *p - '0';
+    } else if (*p != '0') {
+      d.truncated = 1;
+    }
+    ++d.num_digits;
+    point += !seen_point;
+  }
+  if (d.num_digits > NUMBER_MAX_DIGITS) {
+    d.num_digits = NUMBER_MAX_DIGITS;
+  }
+  big_decimal_trim(&d);
+  point += exponent;
+  if (d.num_digits == 0 || point < -324) {
+    return answer;
+  } else if (point >= 310) {
+    answer.power2 = 0x7FF;
+    return answer;
+  }
+  d.decimal_point = (int32_t)point;
+  int32_t exp2 = 0;
+  while (d.decimal_point > 0) {
+    uint32_t n = (uint32_t)d.decimal_point;
+    uint32_t shift = n < num_powers ? powers[n] : max_shift;
+    big_decimal_right_shift(&d, shift);
+    if (d.decimal_point < -NUMBER_DECIMAL_POINT_RANGE) {
+      return answer;
+    }
+    exp2 += (int32_t)shift;
+  }
+  while (d.decimal_point <= 0) {
+    uint32_t shift;
+    if (d.decimal_point == 0) {
+      if (d.digits[0] >= 5) {
+        break;
+      }
+      shift = d.digits[0] < 2 ? 2 : 1;
+    } else {
+      uint32_t n = (uint32_t)-d.decimal_point;
+      shift = n < num_powers ? powers[n] : max_shift;
+    }
+    big_decimal_left_shift(&d, shift);
+    if (d.decimal_point > NUMBER_DECIMAL_POINT_RANGE) {
+      answer.power2 = 0x7FF;
+      return answer;
+    }
+    exp2 -= (int32_t)shift;
+  }
+  --exp2;
+  while (-1022 > exp2) {
+    uint32_t n = (uint32_t)(-1022 - exp2);
+    if (n > max_shift) {
+      n = max_shift;
+    }
+    big_decimal_right_shift(&d, n);
+    exp2 += (int32_t)n;
+  }
+  if (exp2 + 1023 >= 0x7FF) {
+    answer.power2 = 0x7FF;
+    return answer;
+  }
+  big_decimal_left_shift(&d, 53);
+  uint64_t mantissa = big_decimal_round(&d);
+  if (mantissa >= ((uint64_t)1 << 53)) {
+    big_decimal_right_shift(&d, 1);
+    ++exp2;
+    mantissa = big_decimal_round(&d);
+    if (exp2 + 1023 >= 0x7FF) {
+      answer.power2 = 0x7FF;
+      return answer;
+    }
+  }
+  answer.power2 = exp2 + 1023;
+  if (mantissa < ((uint64_t)1 << 52)) {
+    --answer.power2;
+  }
+  answer.mantissa = mantissa & (((uint64_t)1 << 52) - 1);
+  return answer;
+}
+
+static double binary_to_double(struct binary_float f, int negative) {
+  uint64_t bits = f.mantissa | (uint64_t)f.power2 << 52 | (uint64_t)negative << 63;
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+// On NUMBER_ERROR *stop points at the offending character and *expect says
+// what was required there.
+static int scan_number(const char *p, const char *end, const char **stop, const char **expect, lua_Integer *ival, double *dval) {
+  int negative = 0;
+  if (p < end && *p == '-') {
+    negative = 1;
+    ++p; // '-'
+  }
+  const char *int_start = p;
+  uint64_t w = 0;
+  if (p < end && *p == '0') {
+    ++p; // '0'
+  } else if (p < end && is_digit(*p)) {
+    p = scan_digits(p, end, &w);
+  } else {
+    *stop = p;
+    *expect = "'0'-'9'";
+    return NUMBER_ERROR;
+  }
+  const char *int_end = p;
+  int64_t digit_count = int_end - int_start;
+  const char *frac_start = p;
+  const char *frac_end = p;
+  int is_float = 0;
+  if (p < end && *p == '.') {
+    ++p; // '.'
+    frac_start = p;
+    if (p >= end || !is_digit(*p)) {
+      *stop = p;
+      *expect = "'0'-'9'";
+      return NUMBER_ERROR;
+    }
+    p = scan_digits(p, end, &w);
+    frac_end = p;
+    digit_count += frac_end - frac_start;
+    is_float = 1;
+  }
+  int64_t exponent = -(frac_end - frac_start);
+  int64_t explicit_exponent = 0;
+  const char *mantissa_end = p;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    ++p; // 'e' or 'E'
+    int exp_negative = 0;
+    *expect = "'-' or '+' or '0'-'9'";
+    if (p < end && (*p == '-' || *p == '+')) {
+      exp_negative = *p == '-';
+      ++p; // '-' or '+'
+      *expect = "'0'-'9'";
+    }
+    if (p >= end || !is_digit(*p)) {
+      *stop = p;
+      return NUMBER_ERROR;
+    }
+    int64_t exp_number = 0;
+    for (; p < end && is_digit(*p); ++p) {
+      if (exp_number < 0x10000) {
+        exp_number = 10 * exp_number + (*p - '0');
+      }
+    }
+    explicit_exponent = exp_negative ? -exp_number : exp_number;
+    exponent += explicit_exponent;
+    is_float = 1;
+  }
+  *stop = p;
+  if (!is_float && digit_count <= 19) {
+    if (!negative && w <= (uint64_t)LUA_MAXINTEGER) {
+      *ival = (lua_Integer)w;
+      return NUMBER_INTEGER;
+    } else if (negative && w <= (uint64_t)LUA_MAXINTEGER + 1) {
+      *ival = (lua_Integer)(0 - w);
+      return NUMBER_INTEGER;
+    }
+  }
+  // integers that do not fit fall back to a float
+  int too_many_digits = 0;
+  if (digit_count > 19) {
+    for (const char *c = int_start; c < mantissa_end && (*c == '0' || *c == '.'); ++c) {
+      digit_count -= *c == '0';
+    }
+    if (digit_count > 19) {
+      // keep the first 19 significant digits
+      too_many_digits = 1;
+      w = 0;
+      const char *c = int_start;
+      for (; w < 1000000000000000000ULL && c < int_end; ++c) {
+        w = w * 10 + (*c - '0');
+      }
+      if (w >= 1000000000000000000ULL) {
+        exponent = (int_end - c) + explicit_exponent;
+      } else {
+        for (c = frac_start; w < 1000000000000000000ULL && c < frac_end; ++c) {
+          w = w * 10 + (*c - '0');
+        }
+        exponent = (frac_start - c) + explicit_exponent;
+      }
+    }
+  }
+  if (!too_many_digits && exponent >= -22 && exponent <= 22 && w <= ((uint64_t)1 << 53)) {
+    double d = (double)w;
+    d = exponent < 0 ? d / exact_power_of_ten[-exponent] : d * exact_power_of_ten[exponent];
+    *dval = negative ? -d : d;
+    return NUMBER_FLOAT;
+  }
+  struct binary_float f = eisel_lemire(exponent, w);
+  if (too_many_digits && f.power2 >= 0) {
+    // the dropped digits must not change the result
+    struct binary_float g = eisel_lemire(exponent, w + 1);
+    if (f.mantissa != g.mantissa || f.power2 != g.power2) {
+      f.power2 = -1;
+    }
+  }
+  if (f.power2 < 0) {
+    f = big_decimal_to_binary(int_start, mantissa_end, explicit_exponent);
+  }
+  *dval = binary_to_double(f, negative);
+  return NUMBER_FLOAT;
+}
+
+static const char *parse_number(lua_State *L, struct json_parser *jp, const char *p) {
+  const char *expect;
+  lua_Integer ival;
+  double dval;
+  switch (scan_number(p, jp->end, &p, &expect, &ival, &dval)) {
+  case NUMBER_INTEGER:
+    lua_pushinteger(L, ival);
+    break;
+  case NUMBER_FLOAT:
+    lua_pushnumber(L, dval);
+    break;
+  default:
+    json_parse_error(L, *p, expect);
+  }
+  return p;
+}
+
+// Typed arrays. With JSON_PARSE_TYPED_ARRAYS an array whose first element
+// is a number is checked for holding nothing but numbers and, if so,
+// decoded into one contiguous userdata of lua_Integer or double instead of
+// a table. A float anywhere turns the whole array into doubles.
+
+enum {
+  JSON_ARRAY_INT64,
+  JSON_ARRAY_FLOAT64,
+};
+
+union json_number {
+  lua_Integer i;
+  double d;
+};
+
+struct json_array {
+  int type;
+  size_t len;
+  union json_number v[];
+};
+
+static struct json_array *push_typed_array(lua_State *L, int type, size_t len) {
+  struct json_array *a = lua_newuserdata(L, sizeof(*a) + len * sizeof(a->v[0]));
+  a->type = type;
+  a->len = len;
+  luaL_getmetatable(L, ENCODING_JSON_ARRAY_METATABLE);
+  lua_setmetatable(L, -2);
+  return a;
+}
+
+static int l_encoding_json_array_index(lua_State *L) {
+  struct json_array *a = luaL_checkudata(L, 1, ENCODING_JSON_ARRAY_METATABLE);
+  lua_Integer i = lua_tointeger(L, 2);
+  if (i < 1 || (lua_Unsigned)i > a->len) {
+    return 0;
+  }
+  if (a->type == JSON_ARRAY_INT64) {
+    lua_pushinteger(L, a->v[i-1].i);
+  } else {
+    lua_pushnumber(L, a->v[i-1].d);
+  }
+  return 1;
+}
+
+static int l_encoding_json_array_newindex(lua_State *L) {
+  struct json_array *a = luaL_checkudata(L, 1, ENCODING_JSON_ARRAY_METATABLE);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, i >= 1 && (lua_Unsigned)i <= a->len, 2, "index out of range");
+  if (a->type == JSON_ARRAY_INT64) {
+    a->v[i-1].i = luaL_checkinteger(L, 3);
+  } else {
+    a->v[i-1].d = luaL_checknumber(L, 3);
+  }
+  return 0;
+}
+
+static int l_encoding_json_array_len(lua_State *L) {
+  struct json_array *a = luaL_checkudata(L, 1, ENCODING_JSON_ARRAY_METATABLE);
+  lua_pushinteger(L, (lua_Integer)a->len);
+  return 1;
+}
+
+static const unsigned char typed_array_class[256] = {
+  ['0'] = 1, ['1'] = 1, ['2'] = 1, ['3'] = 1, ['4'] = 1,
+  ['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1, ['9'] = 1,
+  ['-'] = 1, ['+'] = 1, ['.'] = 1, ['e'] = 1, ['E'] = 1,
+  [' '] = 1, ['\n'] = 1, ['\r'] = 1, ['\t'] = 1,
+  [','] = 2, [']'] = 3,
+};
+
+// p points at '[' followed by a number; returns NULL without consuming
+// anything when the array holds something other than numbers
+static const char *parse_typed_array(lua_State *L, struct json_parser *jp, const char *p) {
+  size_t n = 1;
+  const char *c = p + 1;
+  for (;; ++c) {
+    unsigned char k = typed_array_class[(unsigned char)*c];
+    if (k == 0) {
+      return NULL;
+    } else if (k == 2) {
+      ++n;
+    } else if (k == 3) {
+      break;
+    }
+  }
+  struct json_array *a = push_typed_array(L, JSON_ARRAY_INT64, n);
+  size_t i = 0;
+  ++p; // '['
+  p = skip_whitespace(L, jp, p);
+  for (;*p;) {
+    const char *expect;
+    lua_Integer ival;
+    double dval;
+    switch (scan_number(p, jp->end, &p, &expect, &ival, &dval)) {
+    case NUMBER_INTEGER:
+      if (a->type == JSON_ARRAY_INT64) {
+        a->v[i++].i = ival;
+      } else {
+        a->v[i++].d = (double)ival;
+      }
+      break;
+    case NUMBER_FLOAT:
+      if (a->type == JSON_ARRAY_INT64) {
+        for (size_t j = 0; j < i; ++j) {
+          a->v[j].d = (double)a->v[j].i;
+        }
+        a->type = JSON_ARRAY_FLOAT64;
+      }
+      a->v[i++].d = dval;
+      break;
+    default:
+      json_parse_error(L, *p, expect);
+    }
+    p = skip_whitespace(L, jp, p);
+    if (*p != ',') {
+      break;
+    }
+    ++p; // ','
+    p = skip_whitespace(L, jp, p);
+  }
+  if (*p != ']') {
+    json_parse_error(L, *p, "']' or ','");
+  }
+  return p + 1;
+}
+
+// Base64 fields. The parse and stringify options can name object members
+// whose string values are base64, which are then decoded straight from the
+// input into the result string, or encoded straight into the output.
+// Names map to a struct json_base64 in a field table on the stack.
+
+#define JSON_BASE64_STD "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+#define JSON_BASE64_PADDING '='
+
+struct json_base64 {
+  char encode[64];
+  signed char decode[256];
+};
+
+static void push_base64(lua_State *L, const char *alphabet) {
+  struct json_base64 *b64 = lua_newuserdata(L, sizeof(*b64));
+  memset(b64->decode, -1, sizeof(b64->decode));
+  for (int i = 0; i < 64; ++i) {
+    b64->encode[i] = alphabet[i];
+    b64->decode[(unsigned char)alphabet[i]] = (signed char)i;
+  }
+}
+
+// the alphabet of an encoding object from encoding.base64, read back by
+// encoding the 48 bytes whose sextets are 0 to 63
+static void push_base64_of(lua_State *L, int idx, int arg) {
+  unsigned char probe[48];
+  for (int i = 0; i < 16; ++i) {
+    int a = 4 * i, b = a + 1, c = a + 2, d = a + 3;
+    probe[3*i+0] = (unsigned char)(a << 2 | b >> 4);
+    probe[3*i+1] = (unsigned char)((b & 0xF) << 4 | c >> 2);
+    probe[3*i+2] = (unsigned char)((c & 0x3) << 6 | d);
+  }
+  idx = lua_absindex(L, idx);
+  lua_getfield(L, idx, "Encode");
+  lua_pushvalue(L, idx);
+  lua_pushlstring(L, (const char *)probe, sizeof(probe));
+  lua_call(L, 2, 1);
+  size_t len;
+  const char *alphabet = lua_tolstring(L, -1, &len);
+  if (alphabet == NULL || len != 64) {
+    luaL_argerror(L, arg, "base64_fields holds an invalid encoding");
+  }
+  for (int i = 0; i < 64; ++i) {
+    if (!isprint((unsigned char)alphabet[i]) || alphabet[i] == '"' || alphabet[i] == '\\' || alphabet[i] == JSON_BASE64_PADDING) {
+      luaL_argerror(L, arg, "base64 alphabet cannot be used in JSON strings");
+    }
+  }
+  push_base64(L, alphabet);
+  lua_replace(L, -2);
+}
+
+// reads opts.base64_fields, a list of names using the standard alphabet or
+// a table from name to an encoding object, and pushes the field table;
+// returns its index or 0 without pushing anything when there are none
+static int check_base64_fields(lua_State *L, int idx) {
+  if (lua_isnoneornil(L, idx)) {
+    return 0;
+  }
+  luaL_checktype(L, idx, LUA_TTABLE);
+  if (lua_getfield(L, idx, "base64_fields") == LUA_TNIL) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  luaL_argcheck(L, lua_istable(L, -1), idx, "base64_fields must be a table");
+  int names = lua_gettop(L);
+  lua_newtable(L);
+  push_base64(L, JSON_BASE64_STD);
+  lua_pushnil(L);
+  while (lua_next(L, names)) {
+    if (lua_type(L, -2) == LUA_TNUMBER && lua_type(L, -1) == LUA_TSTRING) {
+      lua_pushvalue(L, names + 2);
+    } else if (lua_type(L, -2) == LUA_TSTRING && lua_toboolean(L, -1)) {
+      if (lua_type(L, -1) == LUA_TBOOLEAN) {
+        lua_pushvalue(L, names + 2);
+      } else {
+        push_base64_of(L, -1, idx);
+      }
+      lua_pushvalue(L, -3);
+      lua_replace(L, -3);
+    } else {
+      luaL_argerror(L, idx, "base64_fields must hold field names");
+    }
+    lua_rawset(L, names + 1);
+  }
+  lua_pop(L, 1);
+  lua_replace(L, names);
+  return names;
+}
+
+// p points at the opening quote of a string of base64 text, pushes the
+// bytes it encodes; "\/" is the only escape base64 text can contain
+static const char *parse_base64_string(lua_State *L, struct json_parser *jp, const char *p, const struct json_base64 *b64) {
+  const char *start = ++p; // '"'
+  luaL_Buffer buf;
+  char *out = luaL_buffinitsize(L, &buf, 0);
+  unsigned char quad[4];
+  int q = 0;
+  int padding = 0;
+  for (;; ++p) {
+    unsigned char c = *p;
+    if (c == '"') {
+      break;
+    }
+    const char *at = p;
+    if (c == '\\' && p[1] == '/') {
+      c = '/';
+      ++p;
+    }
+    if (c == JSON_BASE64_PADDING && q >= 2) {
+      ++padding;
+      quad[q++] = 0;
+    } else if (padding == 0 && b64->decode[c] >= 0) {
+      quad[q++] = (unsigned char)b64->decode[c];
+    } else {
+      luaL_error(L, "illegal base64 data at input byte %d", (int)(at - start));
+    }
+    if (q == 4) {
+      out = luaL_prepbuffsize(&buf, 3);
+      out[0] = (char)(quad[0] << 2 | quad[1] >> 4);
+      out[1] = (char)(quad[1] << 4 | quad[2] >> 2);
+      out[2] = (char)(quad[2] << 6 | quad[3]);
+      luaL_addsize(&buf, 3 - padding);
+      q = 0;
+      if (padding > 0 && p[1] != '"') {
+        luaL_error(L, "illegal base64 data at input byte %d", (int)(p + 1 - start));
+      }
+    }
+  }
+  if (q != 0) {
+    luaL_error(L, "illegal base64 data at input byte %d", (int)(p - start));
+  }
+  luaL_pushresult(&buf);
+  return p + 1;
+}
+
+static const char *parse_true(lua_State *L, struct json_parser *jp, const char *p) {
+  if (*p++ != 't' ||
+      *p++ != 'r' ||
+      *p++ != 'u' ||
+      *p++ != 'e') {
+    json_parse_error(L, *(p-1), "true");
+  }
+  lua_pushboolean(L, 1);
+  return p;
+}
+
+static const char *parse_false(lua_State *L, struct json_parser *jp, const char *p) {
+  if (*p++ != 'f' ||
+      *p++ != 'a' ||
+      *p++ != 'l' ||
+      *p++ != 's' ||
+      *p++ != 'e') {
+    json_parse_error(L, *(p-1), "false");
+  }
+  lua_pushboolean(L, 0);
+  return p;
+}
+
+static const char *parse_null(lua_State *L, struct json_parser *jp, const char *p) {
+  if (*p++ != 'n' ||
+      *p++ != 'u' ||
+      *p++ != 'l' ||
+      *p++ != 'l') {
+    json_parse_error(L, *(p-1), "null");
+  }
+  lua_pushnil(L);
+  return p;
+}
+
+static const char *parse_value(lua_State *L, struct json_parser *jp, const char *p) {
+  switch (*p) {
+  case '{':
+    return parse_object(L, jp, p);
+  case '[':
+    return parse_array(L, jp, p);
+  case '"':
+    return parse_string(L, jp, p);
+  case '-':
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9':
+    return parse_number(L, jp, p);
+  case 't':
+    return parse_true(L, jp, p);
+  case 'f':
+    return parse_false(L, jp, p);
+  case 'n':
+    return parse_null(L, jp, p);
+  default:
+    json_parse_error(L, *p, "'{' or '[' or '\"' or '-' or '0'-'9' or 't' or 'f' or 'n'");
+  }
+  return p;
+}
+
+// Number formatting. Integers go through a two-digits-at-a-time table;
+// doubles use Grisu2, which always produces digits that read back to the
+// same double and, in all but a tiny fraction of cases, the shortest such.
+
+#define NUMBER_FORMAT_SIZE 32
+
+static const char digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+// writes v in decimal and returns the number of characters
+static int format_integer(char *out, lua_Integer v) {
+  char tmp[24];
+  char *p = tmp + sizeof(tmp);
+  lua_Unsigned u = (lua_Unsigned)v;
+  if (v < 0) {
+    u = 0 - u;
+  }
+  while (u >= 100) {
+    unsigned d = (unsigned)(u % 100) * 2;
+    u /= 100;
+    *--p = digit_pairs[d+1];
+    *--p = digit_pairs[d];
+  }
+  if (u >= 10) {
+    *--p = digit_pairs[u*2+1];
+    *--p = digit_pairs[u*2];
+  } else {
+    *--p = (char)('0' + u);
+  }
+  if (v < 0) {
+    *--p = '-';
+  }
+  int n = (int)(tmp + sizeof(tmp) - p);
+  memcpy(out, p, n);
+  return n;
+}
+
+struct diy_fp {
+  uint64_t f;
+  int e;
+};
+
+// normalized 10^k for k = -348, -340, ..., 340
+static const uint64_t cached_power_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+  0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+  0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+  0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+  0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+  0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+  0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+  0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+  0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+  0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+  0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+  0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+  0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+  0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+  0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const int16_t cached_power_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+  -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+  -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+  -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+  56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+  694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+  1013, 1039, 1066,
+};
+
+static const uint64_t power_of_ten_u64[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+  10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+static struct diy_fp diy_fp_multiply(struct diy_fp a, struct diy_fp b) {
+  uint64_t hi, lo;
+  full_multiplication(a.f, b.f, &hi, &lo);
+  struct diy_fp r = {hi + (lo >> 63), a.e + b.e + 64};
+  return r;
+}
+
+static struct diy_fp diy_fp_normalize(struct diy_fp v) {
+  int s = __builtin_clzll(v.f);
+  struct diy_fp r = {v.f << s, v.e - s};
+  return r;
+}
+
+// picks c = 10^-k so that the scaled upper boundary has an exponent in [-60, -32]
+static struct diy_fp cached_power(int e, int *k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int)dk;
+  if (dk - ik > 0.0) {
+    ++ik;
+  }
+  unsigned index = (unsigned)((ik >> 3) + 1);
+  *k = -(-348 + (int)(index << 3));
+  struct diy_fp c = {cached_power_f[index], cached_power_e[index]};
+  return c;
+}
+
+static void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[len-1]--;
+    rest += ten_kappa;
+  }
+}
+
+static int count_digits32(uint32_t n) {
+  int d = 1;
+  while (n >= 10 && d < 9) {
+    n /= 10;
+    ++d;
+  }
+  return d;
+}
+
+static int grisu_digits(struct diy_fp w, struct diy_fp mp, uint64_t delta, char *buffer, int *k) {
+  struct diy_fp one = {(uint64_t)1 << -mp.e, mp.e};
+  uint64_t wp_w = mp.f - w.f;
+  uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_digits32(p1);
+  int len = 0;
+  while (kappa > 0) {
+    uint32_t div = (uint32_t)power_of_ten_u64[kappa-1];
+    uint32_t d = p1 / div;
+    p1 %= div;
+    if (d || len) {
+      buffer[len++] = (char)('0' + d);
+    }
+    --kappa;
+    uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      grisu_round(buffer, len, delta, rest, power_of_ten_u64[kappa] << -one.e, wp_w);
+      return len;
+    }
+  }
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    char d = (char)(p2 >> -one.e);
+    if (d || len) {
+      buffer[len++] = (char)('0' + d);
+    }
+    p2 &= one.f - 1;
+    --kappa;
+    if (p2 < delta) {
+      *k += kappa;
+      grisu_round(buffer, len, delta, p2, one.f, -kappa < 20 ? wp_w * power_of_ten_u64[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+// digits of a finite positive v; the value is digits * 10^k
+static int grisu2(double v, char *buffer, int *k) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  int biased = (int)(bits >> 52 & 0x7FF);
+  struct diy_fp w = {bits & (((uint64_t)1 << 52) - 1), 1 - 1075};
+  if (biased != 0) {
+    w.f |= (uint64_t)1 << 52;
+    w.e = biased - 1075;
+  }
+  // boundaries halfway to the neighbouring doubles, sharing plus's exponent
+  struct diy_fp plus = {(w.f << 1) + 1, w.e - 1};
+  while (!(plus.f & ((uint64_t)1 << 53))) {
+    plus.f <<= 1;
+    --plus.e;
+  }
+  plus.f <<= 10;
+  plus.e -= 10;
+  struct diy_fp minus = {(w.f << 1) - 1, w.e - 1};
+  if (w.f == (uint64_t)1 << 52 && biased > 1) {
+    minus.f = (w.f << 2) - 1;
+    minus.e = w.e - 2;
+  }
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+  struct diy_fp c = cached_power(plus.e, k);
+  struct diy_fp sw = diy_fp_multiply(diy_fp_normalize(w), c);
+  struct diy_fp sp = diy_fp_multiply(plus, c);
+  struct diy_fp sm = diy_fp_multiply(minus, c);
+  ++sm.f;
+  --sp.f;
+  return grisu_digits(sw, sp, sp.f - sm.f, buffer, k);
+}
+
+// writes a finite v so that it reads back as the same double and still reads
+// as a float: integral values keep a ".0", and the exponent form is used
+// unless 1e-4 <= |v| < 1e17
+static int format_double(char *out, double v) {
+  char *p = out;
+  if (signbit(v)) {
+    *p++ = '-';
+    v = -v;
+  }
+  if (v == 0) {
+    memcpy(p, "0.0", 3);
+    return (int)(p - out) + 3;
+  }
+  char digits[20];
+  int k;
+  int len = grisu2(v, digits, &k);
+  int point = len + k; // v = 0.digits * 10^point
+  if (point > 0 && point <= 17) {
+    if (k >= 0) {
+      memcpy(p, digits, len);
+      memset(p + len, '0', k);
+      p += point;
+      *p++ = '.';
+      *p++ = '0';
+    } else {
+      memcpy(p, digits, point);
+      p[point] = '.';
+      memcpy(p + point + 1, digits + point, len - point);
+      p += len + 1;
+    }
+  } else if (point <= 0 && point > -4) {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -point);
+    p += -point;
+    memcpy(p, digits, len);
+    p += len;
+  } else {
+    int exp10 = point - 1;
+    *p++ = digits[0];
+    if (len > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    *p++ = 'e';
+    if (exp10 < 0) {
+      *p++ = '-';
+      exp10 = -exp10;
+    } else {
+      *p++ = '+';
+    }
+    if (exp10 >= 100) {
+      *p++ = (char)('0' + exp10 / 100);
+      exp10 %= 100;
+    }
+    *p++ = digit_pairs[exp10*2];
+    *p++ = digit_pairs[exp10*2+1];
+  }
+  return (int)(p - out);
+}
+
+// Output for Stringify. The writer keeps its storage in a userdata at a
+// fixed stack slot instead of a luaL_Buffer, so the traversal is free to
+// push values above it. With a sink the storage is one chunk that is
+// handed to the sink whenever it fills up; without one it grows to hold
+// the whole result.
+
+#define JSON_WRITER_INITIAL_SIZE 256
+#define JSON_WRITER_CHUNK_SIZE (64 * 1024)
+#define JSON_WRITER_MIN_CHUNK_SIZE 64
+
+struct json_writer {
+  lua_State *L;
+  char *buf;
+  size_t n;
+  size_t size;
+  int box;         // stack slot of the storage userdata
+  int sink;        // stack slot of the sink function, 0 for none
+  int self;        // stack slot of the object the sink is a method of, 0 for none
+  FILE *file;      // sink file, if any
+  int canonical;   // object keys in byte order
+  int base64_fields; // stack slot of the base64 field table, 0 for none
+  lua_Integer total;
+  char init[JSON_WRITER_INITIAL_SIZE];
+};
+
+static void writer_init(lua_State *L, struct json_writer *w) {
+  lua_pushnil(L);
+  w->L = L;
+  w->buf = w->init;
+  w->n = 0;
+  w->size = sizeof(w->init);
+  w->box = lua_gettop(L);
+  w->sink = 0;
+  w->self = 0;
+  w->file = NULL;
+  w->canonical = 0;
+  w->base64_fields = 0;
+  w->total = 0;
+}
+
+static void writer_init_sink(lua_State *L, struct json_writer *w, size_t chunk_size) {
+  writer_init(L, w);
+  w->buf = (char *)lua_newuserdata(L, chunk_size);
+  w->size = chunk_size;
+  lua_replace(L, w->box);
+}
+
+static void writer_flush(struct json_writer *w) {
+  lua_State *L = w->L;
+  if (w->n == 0) {
+    return;
+  }
+  if (w->file != NULL) {
+    if (fwrite(w->buf, 1, w->n, w->file) != w->n) {
+      luaL_error(L, "write error: %s", strerror(errno));
+    }
+  } else {
+    lua_pushvalue(L, w->sink);
+    if (w->self != 0) {
+      lua_pushvalue(L, w->self);
+    }
+    lua_pushlstring(L, w->buf, w->n);
+    lua_call(L, w->self != 0 ? 2 : 1, 0);
+  }
+  w->total += w->n;
+  w->n = 0;
+}
+
+// makes room for sz more bytes
+static char *writer_grow(struct json_writer *w, size_t sz) {
+  if (w->file != NULL || w->sink != 0) {
+    writer_flush(w);
+  } else {
+    size_t size = w->size * 2;
+    if (size < w->n + sz) {
+      size = w->n + sz;
+    }
+    char *buf = (char *)lua_newuserdata(w->L, size);
+    memcpy(buf, w->buf, w->n);
+    lua_replace(w->L, w->box);
+    w->buf = buf;
+    w->size = size;
+  }
+  return w->buf + w->n;
+}
+
+// sz must not exceed JSON_WRITER_MIN_CHUNK_SIZE
+#define writer_prepsize(w, sz) ((w)->size - (w)->n >= (sz) ? (w)->buf + (w)->n : writer_grow((w), (sz)))
+#define writer_addsize(w, sz) ((w)->n += (sz))
+#define writer_addchar(w, c) ((void)((w)->n < (w)->size || writer_grow((w), 1)), ((w)->buf[(w)->n++] = (c)))
+#define writer_addstring(w, s) writer_addlstring((w), (s), strlen(s))
+
+static void writer_addlstring(struct json_writer *w, const char *s, size_t len) {
+  if (w->size - w->n < len) {
+    if (w->file == NULL && w->sink == 0) {
+      writer_grow(w, len);
+    } else {
+      while (w->size - w->n < len) {
+        size_t part = w->size - w->n;
+        memcpy(w->buf + w->n, s, part);
+        w->n += part;
+        s += part;
+        len -= part;
+        writer_flush(w);
+      }
+    }
+  }
+  memcpy(w->buf + w->n, s, len);
+  w->n += len;
+}
+
+static void stringify_number(lua_State *L, struct json_writer *w, int idx) {
+  char *out = writer_prepsize(w, NUMBER_FORMAT_SIZE);
+  if (lua_isinteger(L, idx)) {
+    writer_addsize(w, format_integer(out, lua_tointeger(L, idx)));
+    return;
+  }
+  double v = (double)lua_tonumber(L, idx);
+  if (isnan(v) || isinf(v)) {
+    luaL_error(L, "unsupported number value %f", (lua_Number)v);
+  }
+  writer_addsize(w, format_double(out, v));
+}
+
+static void stringify_typed_array(lua_State *L, struct json_writer *w, struct json_array *a) {
+  writer_addchar(w, '[');
+  for (size_t i = 0; i < a->len; ++i) {
+    char *out = writer_prepsize(w, NUMBER_FORMAT_SIZE + 1);
+    char *p = out;
+    if (i > 0) {
+      *p++ = ',';
+    }
+    if (a->type == JSON_ARRAY_INT64) {
+      p += format_integer(p, a->v[i].i);
+    } else if (isnan(a->v[i].d) || isinf(a->v[i].d)) {
+      luaL_error(L, "unsupported number value %f", (lua_Number)a->v[i].d);
+    } else {
+      p += format_double(p, a->v[i].d);
+    }
+    writer_addsize(w, p - out);
+  }
+  writer_addchar(w, ']');
+}
+
+static void stringify_table(lua_State *L, struct json_writer *w, int idx);
+static void stringify_string(lua_State *L, struct json_writer *w, int idx);
+static void stringify_value(lua_State *L, struct json_writer *w, int idx);
+
+static void stringify_base64(lua_State *L, struct json_writer *w, const struct json_base64 *b64, int idx) {
+  size_t len;
+  const unsigned char *s = (const unsigned char *)lua_tolstring(L, idx, &len);
+  const char *map = b64->encode;
+  writer_addchar(w, '"');
+  size_t i = 0;
+  while (len - i >= 3) {
+    // up to 16 groups per reservation
+    char *out = writer_prepsize(w, JSON_WRITER_MIN_CHUNK_SIZE);
+    size_t n = (len - i) / 3 < 16 ? (len - i) / 3 : 16;
+    for (size_t k = 0; k < n; ++k, i += 3, out += 4) {
+      out[0] = map[s[i] >> 2];
+      out[1] = map[(s[i] & 0x3) << 4 | s[i+1] >> 4];
+      out[2] = map[(s[i+1] & 0xF) << 2 | s[i+2] >> 6];
+      out[3] = map[s[i+2] & 0x3F];
+    }
+    writer_addsize(w, 4 * n);
+  }
+  if (len - i == 1) {
+    writer_addchar(w, map[s[i] >> 2]);
+    writer_addchar(w, map[(s[i] & 0x3) << 4]);
+    writer_addchar(w, JSON_BASE64_PADDING);
+    writer_addchar(w, JSON_BASE64_PADDING);
+  } else if (len - i == 2) {
+    writer_addchar(w, map[s[i] >> 2]);
+    writer_addchar(w, map[(s[i] & 0x3) << 4 | s[i+1] >> 4]);
+    writer_addchar(w, map[(s[i+1] & 0xF) << 2]);
+    writer_addchar(w, JSON_BASE64_PADDING);
+  }
+  writer_addchar(w, '"');
+}
+
+// writes the value of a member, base64 encoded when the key names a base64 field
+static void stringify_member(lua_State *L, struct json_writer *w, int key, int value) {
+  if (w->base64_fields != 0 && lua_type(L, key) == LUA_TSTRING && lua_type(L, value) == LUA_TSTRING) {
+    key = lua_absindex(L, key);
+    value = lua_absindex(L, value);
+    lua_pushvalue(L, key);
+    if (lua_rawget(L, w->base64_fields) == LUA_TUSERDATA) {
+      stringify_base64(L, w, lua_touserdata(L, -1), value);
+      lua_pop(L, 1);
+      return;
+    }
+    lua_pop(L, 1);
+  }
+  stringify_value(L, w, value);
+}
+
+// Canonical output writes the members of an object in the byte order of
+// their key text, which is UTF-8 code point order for string keys. Keys
+// are written as Stringify writes them, so 1 and "1" both come out as "1";
+// such a pair is an error, since a canonical object names a member once
+// and qsort would leave the order of the two to chance.
+
+struct json_sorted_key {
+  const char *s;
+  size_t len;
+  int ref; // index of the key text in the key table, the key itself follows
+};
+
+static int compare_sorted_key(const void *a, const void *b) {
+  const struct json_sorted_key *x = a;
+  const struct json_sorted_key *y = b;
+  int c = memcmp(x->s, y->s, x->len < y->len ? x->len : y->len);
+  if (c != 0) {
+    return c;
+  }
+  return x->len < y->len ? -1 : x->len > y->len;
+}
+
+static void stringify_sorted_object(lua_State *L, struct json_writer *w, int idx) {
+  int n = 0;
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    lua_pop(L, 1);
+    int type = lua_type(L, -1);
+    n += type == LUA_TSTRING || type == LUA_TNUMBER || type == LUA_TBOOLEAN;
+  }
+  lua_createtable(L, 2 * n, 0);
+  int keys = lua_gettop(L);
+  struct json_sorted_key *order = lua_newuserdata(L, n * sizeof(*order));
+  int i = 0;
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    lua_pop(L, 1);
+    char text[NUMBER_FORMAT_SIZE];
+    switch (lua_type(L, -1)) {
+    case LUA_TSTRING:
+      lua_pushvalue(L, -1);
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, -1)) {
+        lua_pushlstring(L, text, format_integer(text, lua_tointeger(L, -1)));
+      } else if (isinf(lua_tonumber(L, -1))) {
+        lua_pushstring(L, lua_tonumber(L, -1) > 0 ? "inf" : "-inf");
+      } else {
+        lua_pushlstring(L, text, format_double(text, lua_tonumber(L, -1)));
+      }
+      break;
+    case LUA_TBOOLEAN:
+      lua_pushstring(L, lua_toboolean(L, -1) ? "true" : "false");
+      break;
+    default:
+      continue;
+    }
+    order[i].s = lua_tolstring(L, -1, &order[i].len);
+    order[i].ref = 2 * i + 1;
+    lua_rawseti(L, keys, 2 * i + 1);
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, keys, 2 * i + 2);
+    ++i;
+  }
+  qsort(order, n, sizeof(*order), compare_sorted_key);
+  for (i = 1; i < n; ++i) {
+    if (compare_sorted_key(&order[i - 1], &order[i]) == 0) {
+      luaL_error(L, "duplicate key '%s' in canonical output", order[i].s);
+    }
+  }
+  writer_addchar(w, '{');
+  for (i = 0; i < n; ++i) {
+    if (i > 0) {
+      writer_addchar(w, ',');
+    }
+    lua_rawgeti(L, keys, order[i].ref);
+    stringify_string(L, w, -1);
+    writer_addchar(w, ':');
+    lua_rawgeti(L, keys, order[i].ref + 1);
+    lua_rawget(L, idx);
+    stringify_member(L, w, -2, -1);
+    lua_pop(L, 2);
+  }
+  writer_addchar(w, '}');
+  lua_pop(L, 2);
+}
+
+static void stringify_table(lua_State *L, struct json_writer *w, int idx) {
+  idx = lua_absindex(L, idx);
+  lua_Unsigned len = lua_rawlen(L, idx);
+  if (len == 0 && w->canonical) {
+    stringify_sorted_object(L, w, idx);
+  } else if (len > 0) {
+    writer_addchar(w, '[');
+    for (lua_Unsigned i = 0; i < len; ++i) {
+      if (i > 0) {
+        writer_addchar(w, ',');
+      }
+      lua_rawgeti(L, idx, i+1);
+      stringify_value(L, w, -1);
+      lua_pop(L, 1);
+    }
+    writer_addchar(w, ']');
+  } else {
+    writer_addchar(w, '{');
+    lua_pushnil(L);
+    int begin = 1;
+    while (lua_next(L, idx)) {
+      if (begin == 1) {
+        begin = 0;
+      } else {
+        writer_addchar(w, ',');
+      }
+      int type = lua_type(L, -2);
+      switch (type) {
+      case LUA_TNIL:
+        writer_addstring(w, "\"null\"");
+        break;
+      case LUA_TBOOLEAN:
+        if (lua_toboolean(L, -2)) {
+          writer_addstring(w, "\"true\"");
+        } else {
+          writer_addstring(w, "\"false\"");
+        }
+        break;
+      case LUA_TNUMBER:
+        writer_addchar(w, '"');
+        if (lua_isinteger(L, -2) || !isinf(lua_tonumber(L, -2))) {
+          stringify_number(L, w, -2);
+        } else {
+          writer_addstring(w, lua_tonumber(L, -2) > 0 ? "inf" : "-inf");
+        }
+        writer_addchar(w, '"');
+        break;
+      case LUA_TSTRING:
+        stringify_string(L, w, -2);
+        break;
+      case LUA_TTABLE:
+      default:
+        goto label_skip;
+      }
+      writer_addchar(w, ':');
+      stringify_member(L, w, -2, -1);
+label_skip:
+      lua_pop(L, 1);
+    }
+    writer_addchar(w, '}');
+  }
+}
+
+static const char hexmap[] = {
+  '0', '1', '2', '3',
+  '4', '5', '6', '7',
+  '8', '9', 'A', 'B',
+  'C', 'D', 'E', 'F',
+};
+
+static void stringify_string(lua_State *L, struct json_writer *w, int idx) {
+  idx = lua_absindex(L, idx);
+  size_t len;
+  const char *s = lua_tolstring(L, idx, &len);
+  writer_addchar(w, '"');
+  size_t run = 0;
+  for (size_t i = json_plain_run(s, len, '/'); i < len; i += json_plain_run(s + i, len - i, '/')) {
+    unsigned char c = s[i];
+    if (c >= 0x80) {
+      size_t n = utf8_sequence(s + i, len - i);
+      if (n == 0) {
+        luaL_error(L, "invalid UTF-8 sequence at byte %d", (int)i + 1);
+      }
+      i += n;
+      continue;
+    }
+    writer_addlstring(w, s + run, i - run);
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      writer_addchar(w, '\\');
+      writer_addchar(w, c);
+      break;
+    case '\b':
+      writer_addstring(w, "\\b");
+      break;
+    case '\f':
+      writer_addstring(w, "\\f");
+      break;
+    case '\n':
+      writer_addstring(w, "\\n");
+      break;
+    case '\r':
+      writer_addstring(w, "\\r");
+      break;
+    case '\t':
+      writer_addstring(w, "\\t");
+      break;
+    default:
+      writer_addstring(w, "\\u00");
+      writer_addchar(w, hexmap[c>>4]);
+      writer_addchar(w, hexmap[c&0xF]);
+      break;
+    }
+    run = ++i;
+  }
+  writer_addlstring(w, s + run, len - run);
+  writer_addchar(w, '"');
+}
+
+static void stringify_value(lua_State *L, struct json_writer *w, int idx) {
+  idx = lua_absindex(L, idx);
+  int type = lua_type(L, idx);
+  switch (type) {
+  case LUA_TNIL:
+    writer_addstring(w, "null");
+    break;
+  case LUA_TBOOLEAN:
+    if (lua_toboolean(L, idx)) {
+      writer_addstring(w, "true");
+    } else {
+      writer_addstring(w, "false");
+    }
+    break;
+  case LUA_TNUMBER:
+    stringify_number(L, w, idx);
+    break;
+  case LUA_TSTRING:
+    stringify_string(L, w, idx);
+    break;
+  case LUA_TTABLE:
+    stringify_table(L, w, idx);
+    break;
+  case LUA_TUSERDATA: {
+    struct json_array *a = luaL_testudata(L, idx, ENCODING_JSON_ARRAY_METATABLE);
+    if (a != NULL) {
+      stringify_typed_array(L, w, a);
+    }
+    break;
+  }
+  }
+}
+
+// reads opts.chunk_size and opts.canonical from the options at idx
+static void check_writer_options(lua_State *L, int idx, lua_Integer *chunk_size, int *canonical) {
+  *chunk_size = JSON_WRITER_CHUNK_SIZE;
+  *canonical = 0;
+  if (lua_isnoneornil(L, idx)) {
+    return;
+  }
+  luaL_checktype(L, idx, LUA_TTABLE);
+  lua_getfield(L, idx, "chunk_size");
+  *chunk_size = luaL_optinteger(L, -1, JSON_WRITER_CHUNK_SIZE);
+  luaL_argcheck(L, *chunk_size >= JSON_WRITER_MIN_CHUNK_SIZE, idx, "chunk_size too small");
+  lua_getfield(L, idx, "canonical");
+  *canonical = lua_toboolean(L, -1);
+  lua_pop(L, 2);
+}
+
+// json.Stringify(value [, opts]), opts.canonical sorts object keys and
+// opts.base64_fields names string members to write as base64
+static int l_encoding_json_stringify(lua_State *L) {
+  lua_Integer chunk_size;
+  int canonical;
+  check_writer_options(L, 2, &chunk_size, &canonical);
+  lua_settop(L, 2);
+  int fields = check_base64_fields(L, 2);
+  struct json_writer w;
+  writer_init(L, &w);
+  w.canonical = canonical;
+  w.base64_fields = fields;
+  stringify_value(L, &w, 1);
+  lua_pushlstring(L, w.buf, w.n);
+  return 1;
+}
+
+// json.StringifyTo(value, sink [, opts]) writes value to an io file or
+// passes it to a function in chunks of opts.chunk_size bytes, and returns
+// the number of bytes written.
+static int l_encoding_json_stringify_to(lua_State *L) {
+  luaL_Stream *stream = (luaL_Stream *)luaL_testudata(L, 2, LUA_FILEHANDLE);
+  if (stream == NULL && lua_type(L, 2) != LUA_TFUNCTION) {
+    luaL_argerror(L, 2, "file or function expected");
+  } else if (stream != NULL && stream->closef == NULL) {
+    luaL_argerror(L, 2, "attempt to use a closed file");
+  }
+  lua_Integer chunk_size;
+  int canonical;
+  check_writer_options(L, 3, &chunk_size, &canonical);
+  lua_settop(L, 3);
+  int fields = check_base64_fields(L, 3);
+  struct json_writer w;
+  writer_init_sink(L, &w, (size_t)chunk_size);
+  w.canonical = canonical;
+  w.base64_fields = fields;
+  if (stream != NULL) {
+    w.file = stream->f;
+  } else {
+    w.sink = 2;
+  }
+  stringify_value(L, &w, 1);
+  writer_flush(&w);
+  lua_pushinteger(L, w.total);
+  return 1;
+}
+
+// json.HashCanonical(value, hasher [, opts]) feeds the canonical form of
+// value to hasher:Write in chunks of opts.chunk_size bytes, so that equal
+// values hash equally without building the whole string. Returns the
+// number of bytes written.
+static int l_encoding_json_hash_canonical(lua_State *L) {
+  luaL_checkany(L, 2);
+  lua_Integer chunk_size;
+  int canonical;
+  check_writer_options(L, 3, &chunk_size, &canonical);
+  lua_settop(L, 3);
+  int fields = check_base64_fields(L, 3);
+  lua_getfield(L, 2, "Write");
+  if (lua_type(L, -1) != LUA_TFUNCTION) {
+    luaL_argerror(L, 2, "object with a Write method expected");
+  }
+  int sink = lua_gettop(L);
+  struct json_writer w;
+  writer_init_sink(L, &w, (size_t)chunk_size);
+  w.canonical = 1;
+  w.base64_fields = fields;
+  w.sink = sink;
+  w.self = 2;
+  stringify_value(L, &w, 1);
+  writer_flush(&w);
+  lua_pushinteger(L, w.total);
+  return 1;
+}
+
+struct json_parse_options {
+  int flags; // JSON_PARSE_*
+  int base64_fields;
+};
+
+// pushes the single value held by the NUL-terminated data; keys is a
+// cache whose anchor table is already set up, or NULL for a per-parse one
+static void parse_document(lua_State *L, const char *data, size_t len, struct json_key_cache *keys, const struct json_parse_options *opts) {
+  int top = lua_gettop(L);
+  struct json_parser parser = {data, data + len, NULL, 0};
+  struct json_parser *jp = &parser;
+  if (opts != NULL) {
+    parser.flags = opts->flags;
+    parser.base64_fields = opts->base64_fields;
+  }
+  struct json_key_cache local;
+  if (worth_indexing(data, len)) {
+    parser.index = build_index(L, data, len)->pos;
+  }
+  if (keys == NULL && len >= JSON_KEY_CACHE_MIN_SIZE) {
+    memset(local.slots, 0, sizeof(local.slots));
+    lua_createtable(L, JSON_KEY_CACHE_SIZE, 0);
+    local.table = lua_gettop(L);
+    keys = &local;
+  }
+  parser.keys = keys;
+  data = skip_whitespace(L, jp, data);
+  data = parse_value(L, jp, data);
+  data = skip_whitespace(L, jp, data);
+  if (*data) {
+    json_parse_error(L, *data, "'\\0'");
+  }
+  if (data != jp->end) {
+    // a NUL inside the input, not its end
+    json_parse_error(L, *data, "end of input");
+  }
+  if (lua_gettop(L) > top + 1) {
+    lua_replace(L, top + 1);
+    lua_settop(L, top + 1);
+  }
+}
+
+// reads opts.numeric_arrays and opts.base64_fields from the options at
+// idx, which must be the top of the stack; may push the field table
+static void check_parse_options(lua_State *L, int idx, struct json_parse_options *opts) {
+  opts->flags = 0;
+  opts->base64_fields = 0;
+  if (lua_isnoneornil(L, idx)) {
+    return;
+  }
+  luaL_checktype(L, idx, LUA_TTABLE);
+  lua_getfield(L, idx, "numeric_arrays");
+  const char *mode = luaL_optstring(L, -1, "table");
+  if (strcmp(mode, "typed") == 0) {
+    opts->flags |= JSON_PARSE_TYPED_ARRAYS;
+  } else if (strcmp(mode, "table") != 0) {
+    luaL_argerror(L, idx, "numeric_arrays must be 'table' or 'typed'");
+  }
+  lua_pop(L, 1);
+  opts->base64_fields = check_base64_fields(L, idx);
+}
+
+// json.Parse(data [, opts]), opts.numeric_arrays = "typed" decodes arrays
+// of numbers into typed arrays and opts.base64_fields names string
+// members to decode from base64
+static int l_encoding_json_parse(lua_State *L) {
+  size_t len;
+  const char *data = lua_tolstring(L, 1, &len);
+  struct json_parse_options opts;
+  lua_settop(L, 2);
+  check_parse_options(L, 2, &opts);
+  parse_document(L, data, len, NULL, &opts);
+  return 1;
+}
+
+// ParseFile parses straight from a read-only mapping of the file. The file
+// is mapped over an anonymous mapping one page longer, so the bytes after
+// its end read as the NUL the parser stops at even when the size is a
+// multiple of the page size. The mapping lives in a userdata so that a
+// parse error does not leak it.
+
+struct json_mapping {
+  char *data;
+  size_t size;
+};
+
+static void unmap_mapping(struct json_mapping *m) {
+  if (m->data != NULL) {
+    munmap(m->data, m->size);
+    m->data = NULL;
+  }
+}
+
+static int l_encoding_json_mapping_gc(lua_State *L) {
+  unmap_mapping(luaL_checkudata(L, 1, ENCODING_JSON_MAPPING_METATABLE));
+  return 0;
+}
+
+static int l_encoding_json_parse_file(lua_State *L) {
+  const char *path = luaL_checkstring(L, 1);
+  struct json_parse_options opts;
+  lua_settop(L, 2);
+  check_parse_options(L, 2, &opts);
+  struct json_mapping *m = lua_newuserdata(L, sizeof(*m));
+  m->data = NULL;
+  luaL_getmetatable(L, ENCODING_JSON_MAPPING_METATABLE);
+  lua_setmetatable(L, -2);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return luaL_error(L, "%s: %s", path, strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return luaL_error(L, "%s: %s", path, strerror(err));
+  }
+  size_t len = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (len / page + 1) * page;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return luaL_error(L, "%s: %s", path, strerror(ENOMEM));
+  }
+  m->data = data;
+  m->size = size;
+  if (len > 0 && mmap(data, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    return luaL_error(L, "%s: %s", path, strerror(err));
+  }
+  close(fd);
+  madvise(data, len, MADV_SEQUENTIAL);
+  parse_document(L, data, len, NULL, &opts);
+  unmap_mapping(m);
+  return 1;
+}
+
+// ParseInto fills an existing table. Objects and arrays land in the table
+// already stored under the same key or index when there is one, so a
+// stream of same-shaped messages reuses one tree of tables. Keys written to
+// an object are recorded as spans of the source text on a stack kept in
+// an upvalue; afterwards every key of the table that is not among them is
+// removed.
+
+#define JSON_INTO_INITIAL_KEYS 64
+
+struct json_into_key {
+  const char *raw; // key as written in the source, without quotes
+  size_t len;
+  int escaped;
+};
+
+struct json_into_arena {
+  size_t cap;
+  struct json_into_key keys[1];
+};
+
+struct json_into {
+  int slot; // stack index of the arena
+  struct json_into_arena *arena;
+  size_t n;
+};
+
+// room for records entries past the ones in use
+static struct json_into_key *into_reserve(lua_State *L, struct json_into *in, size_t records) {
+  struct json_into_arena *a = in->arena;
+  if (a == NULL || a->cap - in->n < records) {
+    size_t cap = a != NULL ? a->cap * 2 : JSON_INTO_INITIAL_KEYS;
+    if (cap < in->n + records) {
+      cap = in->n + records;
+    }
+    struct json_into_arena *b = lua_newuserdata(L, sizeof(*b) + cap * sizeof(b->keys[0]));
+    b->cap = cap;
+    if (in->n > 0) {
+      memcpy(b->keys, a->keys, in->n * sizeof(a->keys[0]));
+    }
+    lua_replace(L, in->slot);
+    in->arena = b;
+  }
+  return in->arena->keys + in->n;
+}
+
+// whether the string at the top of the stack equals the recorded key
+static int into_key_equal(lua_State *L, struct json_parser *jp, const struct json_into_key *k, const char *s, size_t len) {
+  if (!k->escaped) {
+    return k->len == len && memcmp(k->raw, s, len) == 0;
+  }
+  parse_string(L, jp, k->raw - 1);
+  size_t dlen;
+  const char *d = lua_tolstring(L, -1, &dlen);
+  int equal = dlen == len && memcmp(d, s, len) == 0;
+  lua_pop(L, 1);
+  return equal;
+}
+
+// removes the keys of the table at t that are not among the records from base
+static void into_remove_stale_keys(lua_State *L, struct json_parser *jp, struct json_into *in, int t, size_t base) {
+  size_t m = in->n - base;
+  size_t size = 8;
+  while (size < 2 * m) {
+    size <<= 1;
+  }
+  // a hash of the unescaped records goes right after them
+  size_t words = (size * sizeof(uint32_t) + sizeof(struct json_into_key) - 1) / sizeof(struct json_into_key);
+  uint32_t *slots = (uint32_t *)into_reserve(L, in, words);
+  struct json_into_key *keys = in->arena->keys + base;
+  memset(slots, 0, size * sizeof(uint32_t));
+  size_t escaped = 0;
+  for (size_t i = 0; i < m; ++i) {
+    if (keys[i].escaped) {
+      ++escaped;
+      continue;
+    }
+    size_t h = (size_t)(key_hash(keys[i].raw, keys[i].len) >> 32) & (size - 1);
+    while (slots[h] != 0) {
+      h = (h + 1) & (size - 1);
+    }
+    slots[h] = (uint32_t)i + 1;
+  }
+  lua_pushnil(L);
+  while (lua_next(L, t)) {
+    lua_pop(L, 1);
+    int keep = 0;
+    if (lua_type(L, -1) == LUA_TSTRING) {
+      size_t len;
+      const char *s = lua_tolstring(L, -1, &len);
+      size_t h = (size_t)(key_hash(s, len) >> 32) & (size - 1);
+      for (; slots[h] != 0 && !keep; h = (h + 1) & (size - 1)) {
+        keep = into_key_equal(L, jp, &keys[slots[h]-1], s, len);
+      }
+      for (size_t i = 0; i < m && escaped > 0 && !keep; ++i) {
+        keep = keys[i].escaped && into_key_equal(L, jp, &keys[i], s, len);
+      }
+    }
+    if (!keep) {
+      lua_pushvalue(L, -1);
+      lua_pushnil(L);
+      lua_rawset(L, t);
+    }
+  }
+}
+
+static const char *parse_into_container(lua_State *L, struct json_parser *jp, struct json_into *in, const char *p, int t);
+
+// parses the value for the key or index at the top of the stack into the
+// table at t, reusing the table already there for objects and arrays;
+// returns with the key popped and sets *nil when the value is null
+static const char *parse_into_member(lua_State *L, struct json_parser *jp, struct json_into *in, const char *p, int t, int *nil) {
+  *nil = 0;
+  if (*p == '{' || *p == '[') {
+    lua_pushvalue(L, -1);
+    if (lua_rawget(L, t) == LUA_TTABLE) {
+      p = parse_into_container(L, jp, in, p, lua_gettop(L));
+      lua_pop(L, 2);
+      return p;
+    }
+    lua_pop(L, 1);
+  }
+  p = parse_value(L, jp, p);
+  *nil = lua_isnil(L, -1);
+  lua_rawset(L, t);
+  return p;
+}
+
+static const char *parse_into_object(lua_State *L, struct json_parser *jp, struct json_into *in, const char *p, int t) {
+  size_t base = in->n;
+  ++p; // '{'
+  p = skip_whitespace(L, jp, p);
+  if (*p != '}') {
+    for (;*p;) {
+      if (*p != '"') {
+        json_parse_error(L, *p, "'\"'");
+      }
+      const char *key = p + 1;
+      p = parse_key(L, jp, p);
+      size_t keylen = p - 1 - key;
+      p = skip_whitespace(L, jp, p);
+      if (*p != ':') {
+        json_parse_error(L, *p, "':'");
+      }
+      ++p; // ':'
+      p = skip_whitespace(L, jp, p);
+      int nil;
+      p = parse_into_member(L, jp, in, p, t, &nil);
+      if (!nil) {
+        struct json_into_key *k = into_reserve(L, in, 1);
+        k->raw = key;
+        k->len = keylen;
+        k->escaped = memchr(key, '\\', keylen) != NULL;
+        ++in->n;
+      }
+      p = skip_whitespace(L, jp, p);
+      if (*p != ',') {
+        break;
+      }
+      ++p; // ','
+      p = skip_whitespace(L, jp, p);
+    }
+    if (*p != '}') {
+      json_parse_error(L, *p, "'}' or ','");
+    }
+  }
+  ++p; // '}'
+  into_remove_stale_keys(L, jp, in, t, base);
+  in->n = base;
+  return p;
+}
+
+static const char *parse_into_array(lua_State *L, struct json_parser *jp, struct json_into *in, const char *p, int t) {
+  lua_Integer n = 0;
+  ++p; // '['
+  p = skip_whitespace(L, jp, p);
+  if (*p != ']') {
+    for (;*p;) {
+      int nil;
+      lua_pushinteger(L, ++n);
+      p = parse_into_member(L, jp, in, p, t, &nil);
+      p = skip_whitespace(L, jp, p);
+      if (*p != ',') {
+        break;
+      }
+      ++p; // ','
+      p = skip_whitespace(L, jp, p);
+    }
+    if (*p != ']') {
+      json_parse_error(L, *p, "']' or ','");
+    }
+  }
+  ++p; // ']'
+  lua_pushnil(L);
+  while (lua_next(L, t)) {
+    lua_pop(L, 1);
+    if (!lua_isinteger(L, -1) || lua_tointeger(L, -1) < 1 || lua_tointeger(L, -1) > n) {
+      lua_pushvalue(L, -1);
+      lua_pushnil(L);
+      lua_rawset(L, t);
+    }
+  }
+  return p;
+}
+
+static const char *parse_into_container(lua_State *L, struct json_parser *jp, struct json_into *in, const char *p, int t) {
+  if (*p == '{') {
+    return parse_into_object(L, jp, in, p, t);
+  }
+  return parse_into_array(L, jp, in, p, t);
+}
+
+// json.ParseInto(data, target) parses an object or array into target and
+// returns it
+static int l_encoding_json_parse_into(lua_State *L) {
+  size_t len;
+  const char *data = luaL_checklstring(L, 1, &len);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_settop(L, 2);
+  // check the arena out of the upvalue so that a nested call, or a call
+  // after this one failed, starts with an arena of its own
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_pushnil(L);
+  lua_replace(L, lua_upvalueindex(1));
+  struct json_into in = {3, lua_touserdata(L, 3), 0};
+  struct json_parser parser = {data, data + len, NULL, 0};
+  struct json_parser *jp = &parser;
+  if (worth_indexing(data, len)) {
+    parser.index = build_index(L, data, len)->pos;
+  }
+  data = skip_whitespace(L, jp, data);
+  if (*data != '{' && *data != '[') {
+    json_parse_error(L, *data, "'{' or '['");
+  }
+  data = parse_into_container(L, jp, &in, data, 2);
+  data = skip_whitespace(L, jp, data);
+  if (*data) {
+    json_parse_error(L, *data, "'\\0'");
+  }
+  lua_pushvalue(L, 3);
+  lua_replace(L, lua_upvalueindex(1));
+  lua_settop(L, 2);
+  return 1;
+}
+
+// Lazy documents: a node remembers where its object or array starts in the
+// source string and only turns the members it is asked for into Lua values.
+// Every lookup steps over the members before the one asked for, so Open
+// builds the structural index once and the nodes share it; the index is
+// the user value of the nodes and the source string that of the index.
+
+struct json_document {
+  const char *data;
+  size_t len;
+  size_t offset;
+  const uint32_t *index; // NULL for short documents
+  size_t cursor; // index entry of the opening bracket
+  // the element an array node resolved last, so that walking the array
+  // in order resumes there instead of starting over at '['
+  lua_Unsigned last;
+  size_t last_offset; // 0 until the first lookup
+  size_t last_cursor;
+};
+
+static const unsigned char skip_container_class[256] = {
+  ['\0'] = 1, ['"'] = 2, ['{'] = 3, ['['] = 3, ['}'] = 4, [']'] = 4,
+};
+
+static const unsigned char skip_string_class[256] = {
+  ['\0'] = 1, ['"'] = 2, ['\\'] = 3,
+};
+
+static const unsigned char skip_scalar_class[256] = {
+  ['\0'] = 1, [' '] = 1, ['\n'] = 1, ['\r'] = 1, ['\t'] = 1, [','] = 1, [']'] = 1, ['}'] = 1,
+};
+
+static const char *skip_string(lua_State *L, const char *p) {
+  ++p; // '"'
+  for (;;) {
+    for (; skip_string_class[(unsigned char)*p] == 0; ++p);
+    switch (skip_string_class[(unsigned char)*p]) {
+    case 2:
+      return p + 1;
+    case 3:
+      if (p[1] == '\0') {
+        json_parse_error(L, p[1], "'\"'");
+      }
+      p += 2;
+      break;
+    default:
+      json_parse_error(L, *p, "'\"'");
+    }
+  }
+}
+
+// moves past the bracket that closes depth containers open at p
+static const char *skip_nested(lua_State *L, const char *p, size_t depth) {
+  for (;;) {
+    for (; skip_container_class[(unsigned char)*p] == 0; ++p);
+    switch (skip_container_class[(unsigned char)*p]) {
+    case 1:
+      json_parse_error(L, *p, "'}' or ']'");
+      break;
+    case 2:
+      p = skip_string(L, p);
+      break;
+    case 3:
+      ++depth;
+      ++p;
+      break;
+    case 4:
+      ++p;
+      if (--depth == 0) {
+        return p;
+      }
+      break;
+    }
+  }
+}
+
+// moves past the container opening at p by counting brackets in the index,
+// strings that may hold a NUL are still checked byte by byte
+static const char *skip_indexed(lua_State *L, struct json_parser *jp, const char *p) {
+  const uint32_t *index = jp->index;
+  size_t cursor = index_seek(jp, p);
+  if (index[cursor] != (uint32_t)(p - jp->data)) {
+    return skip_nested(L, p, 0);
+  }
+  size_t depth = 0;
+  for (;; ++cursor) {
+    const char *c = jp->data + (index[cursor] & JSON_INDEX_POS);
+    switch (*c) {
+    case '{':
+    case '[':
+      ++depth;
+      break;
+    case '}':
+    case ']':
+      if (--depth == 0) {
+        jp->cursor = cursor + 1;
+        return c + 1;
+      }
+      break;
+    case '"':
+      if (index[cursor] & JSON_INDEX_SLOW) {
+        skip_string(L, jp->data + (index[cursor - 1] & JSON_INDEX_POS));
+      }
+      break;
+    case '\0':
+      json_parse_error(L, *c, "'}' or ']'");
+      break;
+    }
+  }
+}
+
+// moves past one value without building it, only brackets and quotes are matched
+static const char *skip_value(lua_State *L, struct json_parser *jp, const char *p) {
+  switch (*p) {
+  case '"':
+    if (jp->index != NULL) {
+      const char *e = indexed_string_end(jp, p);
+      if (e != NULL) {
+        return e + 1;
+      }
+    }
+    return skip_string(L, p);
+  case '{':
+  case '[':
+    return jp->index != NULL ? skip_indexed(L, jp, p) : skip_nested(L, p, 0);
+  default:
+    if (skip_scalar_class[(unsigned char)*p]) {
+      json_parse_error(L, *p, "'{' or '[' or '\"' or '-' or '0'-'9' or 't' or 'f' or 'n'");
+    }
+    for (; skip_scalar_class[(unsigned char)*p] == 0; ++p);
+    return p;
+  }
+}
+
+// p points at '{', returns the value of the first member named key or NULL
+static const char *document_find_key(lua_State *L, struct json_parser *jp, const char *p, const char *key, size_t keylen) {
+  ++p; // '{'
+  p = skip_whitespace(L, jp, p);
+  if (*p == '}') {
+    return NULL;
+  }
+  for (;*p;) {
+    if (*p != '"') {
+      json_parse_error(L, *p, "'\"'");
+    }
+    const char *k = p + 1;
+    const char *e = jp->index != NULL ? indexed_string_end(jp, p) : NULL;
+    e = e != NULL ? e + 1 : skip_string(L, p);
+    size_t rawlen = e - k - 1;
+    int match;
+    if (memchr(k, '\\', rawlen) == NULL) {
+      match = rawlen == keylen && memcmp(k, key, keylen) == 0;
+    } else {
+      size_t len;
+      parse_string(L, jp, p);
+      const char *s = lua_tolstring(L, -1, &len);
+      match = len == keylen && memcmp(s, key, keylen) == 0;
+      lua_pop(L, 1);
+    }
+    p = skip_whitespace(L, jp, e);
+    if (*p != ':') {
+      json_parse_error(L, *p, "':'");
+    }
+    ++p; // ':'
+    p = skip_whitespace(L, jp, p);
+    if (match) {
+      return p;
+    }
+    p = skip_value(L, jp, p);
+    p = skip_whitespace(L, jp, p);
+    if (*p != ',') {
+      break;
+    }
+    ++p; // ','
+    p = skip_whitespace(L, jp, p);
+  }
+  if (*p != '}') {
+    json_parse_error(L, *p, "'}' or ','");
+  }
+  return NULL;
+}
+
+// p points at '[', returns the i-th (0-based) element or NULL; node is the
+// node p belongs to, or NULL when the lookup must not be remembered
+static const char *document_find_index(lua_State *L, struct json_parser *jp, const char *p, lua_Unsigned i, struct json_document *node) {
+  lua_Unsigned k = 0;
+  if (node != NULL && node->last_offset != 0 && i >= node->last) {
+    k = node->last;
+    p = jp->data + node->last_offset;
+    jp->cursor = node->last_cursor;
+  } else {
+    ++p; // '['
+    p = skip_whitespace(L, jp, p);
+    if (*p == ']') {
+      return NULL;
+    }
+  }
+  for (;*p; ++k) {
+    if (k == i) {
+      if (node != NULL) {
+        node->last = k;
+        node->last_offset = p - jp->data;
+        node->last_cursor = jp->cursor;
+      }
+      return p;
+    }
+    p = skip_value(L, jp, p);
+    p = skip_whitespace(L, jp, p);
+    if (*p != ',') {
+      break;
+    }
+    ++p; // ','
+    p = skip_whitespace(L, jp, p);
+  }
+  if (*p != ']') {
+    json_parse_error(L, *p, "']' or ','");
+  }
+  return NULL;
+}
+
+// pushes a node for containers and the decoded value for scalars,
+// the source string is taken from the user value of the node at idx;
+// returns the end of a scalar and NULL for a container
+static const char *document_push(lua_State *L, struct json_parser *jp, int idx, const char *p) {
+  if (*p != '{' && *p != '[') {
+    return parse_value(L, jp, p);
+  }
+  idx = lua_absindex(L, idx);
+  struct json_document *node = lua_newuserdata(L, sizeof(*node));
+  node->data = jp->data;
+  node->len = jp->end - jp->data;
+  node->offset = p - jp->data;
+  node->index = jp->index;
+  node->cursor = jp->index != NULL ? index_seek(jp, p) : 0;
+  node->last_offset = 0;
+  lua_getuservalue(L, idx);
+  lua_setuservalue(L, -2);
+  luaL_getmetatable(L, ENCODING_JSON_DOCUMENT_METATABLE);
+  lua_setmetatable(L, -2);
+  return NULL;
+}
+
+static int l_encoding_json_document_index(lua_State *L) {
+  struct json_document *node = luaL_checkudata(L, 1, ENCODING_JSON_DOCUMENT_METATABLE);
+  struct json_parser parser = {node->data, node->data + node->len, node->index, node->cursor};
+  const char *p = node->data + node->offset;
+  if (lua_type(L, 2) == LUA_TSTRING) {
+    // methods shadow members of the same name, use Get for those
+    lua_pushvalue(L, 2);
+    if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL) {
+      return 1;
+    }
+    lua_pop(L, 1);
+    if (*p != '{') {
+      return 0;
+    }
+    size_t len;
+    const char *key = lua_tolstring(L, 2, &len);
+    p = document_find_key(L, &parser, p, key, len);
+  } else if (lua_isinteger(L, 2)) {
+    lua_Integer i = lua_tointeger(L, 2);
+    if (*p != '[' || i < 1) {
+      return 0;
+    }
+    p = document_find_index(L, &parser, p, i - 1, node);
+  } else {
+    return 0;
+  }
+  if (p == NULL) {
+    return 0;
+  }
+  document_push(L, &parser, 1, p);
+  return 1;
+}
+
+static int l_encoding_json_document_len(lua_State *L) {
+  struct json_document *node = luaL_checkudata(L, 1, ENCODING_JSON_DOCUMENT_METATABLE);
+  struct json_parser parser = {node->data, node->data + node->len, node->index, node->cursor};
+  struct json_parser *jp = &parser;
+  const char *p = node->data + node->offset;
+  lua_Integer n = 0;
+  if (*p == '[') {
+    ++p; // '['
+    p = skip_whitespace(L, jp, p);
+    for (;*p && *p != ']';) {
+      p = skip_value(L, jp, p);
+      p = skip_whitespace(L, jp, p);
+      ++n;
+      if (*p != ',') {
+        break;
+      }
+      ++p; // ','
+      p = skip_whitespace(L, jp, p);
+    }
+    if (*p != ']') {
+      json_parse_error(L, *p, "']' or ','");
+    }
+  }
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+// JSON Pointer (RFC 6901), array indices are 0-based as in the RFC
+static int l_encoding_json_document_get(lua_State *L) {
+  struct json_document *node = luaL_checkudata(L, 1, ENCODING_JSON_DOCUMENT_METATABLE);
+  size_t len;
+  const char *path = luaL_checklstring(L, 2, &len);
+  const char *end = path + len;
+  struct json_parser parser = {node->data, node->data + node->len, node->index, node->cursor};
+  const char *p = node->data + node->offset;
+  if (len > 0 && *path != '/') {
+    luaL_error(L, "invalid JSON pointer '%s'", path);
+  }
+  // every unescaped token fits in one buffer of the pointer's length
+  char *unescaped = memchr(path, '~', len) != NULL ? lua_newuserdata(L, len) : NULL;
+  for (; path < end && p != NULL;) {
+    ++path; // '/'
+    const char *token = path;
+    for (; path < end && *path != '/'; ++path);
+    if (*p == '{') {
+      const char *key = token;
+      size_t keylen = path - token;
+      if (memchr(token, '~', keylen) != NULL) {
+        keylen = 0;
+        for (const char *c = token; c < path; ++c) {
+          if (*c == '~' && c + 1 < path && (c[1] == '0' || c[1] == '1')) {
+            unescaped[keylen++] = c[1] == '0' ? '~' : '/';
+            ++c;
+          } else {
+            unescaped[keylen++] = *c;
+          }
+        }
+        key = unescaped;
+      }
+      p = document_find_key(L, &parser, p, key, keylen);
+    } else if (*p == '[') {
+      lua_Unsigned i = 0;
+      if (token == path || (path - token > 1 && *token == '0')) {
+        // array indices have no leading zeros
+        p = NULL;
+        break;
+      }
+      for (const char *c = token; c < path; ++c) {
+        if (*c < '0' || *c > '9') {
+          p = NULL;
+          break;
+        }
+        i = i * 10 + (*c - '0');
+      }
+      if (p != NULL) {
+        p = document_find_index(L, &parser, p, i, p == node->data + node->offset ? node : NULL);
+      }
+    } else {
+      p = NULL;
+    }
+  }
+  if (p == NULL) {
+    return 0;
+  }
+  document_push(L, &parser, 1, p);
+  return 1;
+}
+
+static int l_encoding_json_document_decode(lua_State *L) {
+  struct json_document *node = luaL_checkudata(L, 1, ENCODING_JSON_DOCUMENT_METATABLE);
+  struct json_parser parser = {node->data, node->data + node->len, node->index, node->cursor};
+  parse_value(L, &parser, node->data + node->offset);
+  return 1;
+}
+
+// upvalues: the node, the offset to go on from, the index cursor there and
+// the number of members returned so far
+static int l_encoding_json_document_items_next(lua_State *L) {
+  struct json_document *node = lua_touserdata(L, lua_upvalueindex(1));
+  struct json_parser parser = {node->data, node->data + node->len, node->index, (size_t)lua_tointeger(L, lua_upvalueindex(3))};
+  struct json_parser *jp = &parser;
+  const char *p = node->data + lua_tointeger(L, lua_upvalueindex(2));
+  lua_Integer n = lua_tointeger(L, lua_upvalueindex(4));
+  int array = node->data[node->offset] == '[';
+  p = skip_whitespace(L, jp, p);
+  if (*p == (array ? ']' : '}')) {
+    return 0;
+  }
+  if (n > 0) {
+    if (*p != ',') {
+      json_parse_error(L, *p, array ? "']' or ','" : "'}' or ','");
+    }
+    ++p; // ','
+    p = skip_whitespace(L, jp, p);
+  }
+  if (array) {
+    lua_pushinteger(L, n + 1);
+  } else {
+    if (*p != '"') {
+      json_parse_error(L, *p, "'\"'");
+    }
+    p = parse_string(L, jp, p);
+    p = skip_whitespace(L, jp, p);
+    if (*p != ':') {
+      json_parse_error(L, *p, "':'");
+    }
+    ++p; // ':'
+    p = skip_whitespace(L, jp, p);
+  }
+  const char *e = document_push(L, jp, lua_upvalueindex(1), p);
+  if (e == NULL) {
+    e = skip_value(L, jp, p);
+  }
+  lua_pushinteger(L, e - node->data);
+  lua_replace(L, lua_upvalueindex(2));
+  lua_pushinteger(L, (lua_Integer)jp->cursor);
+  lua_replace(L, lua_upvalueindex(3));
+  lua_pushinteger(L, n + 1);
+  lua_replace(L, lua_upvalueindex(4));
+  return 2;
+}
+
+// for i, v in node:Items() walks an array and for k, v in node:Items() an
+// object in one pass over the source
+static int l_encoding_json_document_items(lua_State *L) {
+  struct json_document *node = luaL_checkudata(L, 1, ENCODING_JSON_DOCUMENT_METATABLE);
+  lua_settop(L, 1);
+  lua_pushinteger(L, (lua_Integer)node->offset + 1);
+  lua_pushinteger(L, (lua_Integer)node->cursor);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, l_encoding_json_document_items_next, 4);
+  return 1;
+}
+
+static int l_encoding_json_open(lua_State *L) {
+  size_t len;
+  const char *data = luaL_checklstring(L, 1, &len);
+  struct json_parser parser = {data, data + len, NULL, 0};
+  const char *p = skip_whitespace(L, &parser, data);
+  if (*p != '{' && *p != '[') {
+    // nothing to defer for a scalar document
+    lua_settop(L, 1);
+    return l_encoding_json_parse(L);
+  }
+  struct json_document *node = lua_newuserdata(L, sizeof(*node));
+  node->data = data;
+  node->len = len;
+  node->offset = p - data;
+  node->index = NULL;
+  node->cursor = 0;
+  node->last_offset = 0;
+  if (len >= JSON_INDEX_MIN_SIZE && len < JSON_INDEX_SLOW) {
+    parser.index = build_index(L, data, len)->pos;
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+    node->index = parser.index;
+    node->cursor = index_seek(&parser, p);
+  } else {
+    lua_pushvalue(L, 1);
+  }
+  lua_setuservalue(L, -2);
+  luaL_getmetatable(L, ENCODING_JSON_DOCUMENT_METATABLE);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// Extract resolves a list of JSON Pointers in one pass over the document.
+// The pointers are merged into a trie, members no pointer goes through are
+// stepped over with skip_value, and the scan stops as soon as every
+// pointer has been resolved, so the rest of the document is not looked at.
+// That is also why, for an object naming a member twice, Extract returns
+// the first one, as document lookups do, while Parse keeps the last.
+
+struct json_extract_node {
+  const char *token; // unescaped
+  size_t len;
+  lua_Integer index; // token as an array index, -1 if it is not one
+  int result; // stack index of the value for the pointer ending here, 0 if none
+  int resolved;
+  int pending; // pointers ending here or below that are still unresolved
+  struct json_extract_node *parent;
+  struct json_extract_node *child;
+  struct json_extract_node *next;
+};
+
+struct json_extract {
+  struct json_extract_node *root;
+  int *alias; // for repeated pointers, the stack index of the first one
+};
+
+static struct json_extract_node *extract_child(struct json_extract_node *node, const char *token, size_t len) {
+  struct json_extract_node *c = node->child;
+  for (; c != NULL && (c->len != len || memcmp(c->token, token, len) != 0); c = c->next);
+  return c;
+}
+
+// merges the pointers of the table at idx, their values go to base+1..base+n
+static void compile_extract(lua_State *L, struct json_extract *ex, int idx, int n, int base) {
+  size_t total = 0;
+  for (int i = 1; i <= n; ++i) {
+    lua_rawgeti(L, idx, i);
+    if (lua_type(L, -1) != LUA_TSTRING) {
+      luaL_error(L, "invalid JSON pointer at index %d", i);
+    }
+    total += lua_rawlen(L, -1);
+    lua_pop(L, 1);
+  }
+  // every token takes at least its '/', so there is at most one node per byte
+  size_t size = (total + 1) * sizeof(struct json_extract_node) + n * sizeof(int) + total;
+  struct json_extract_node *nodes = lua_newuserdata(L, size);
+  ex->root = nodes;
+  ex->alias = (int *)(nodes + total + 1);
+  char *tokens = (char *)(ex->alias + n);
+  size_t used = 1;
+  memset(ex->root, 0, sizeof(*ex->root));
+  ex->root->index = -1;
+  for (int i = 1; i <= n; ++i) {
+    size_t len;
+    lua_rawgeti(L, idx, i);
+    const char *path = lua_tolstring(L, -1, &len);
+    const char *end = path + len;
+    if (len > 0 && *path != '/') {
+      luaL_error(L, "invalid JSON pointer '%s'", path);
+    }
+    struct json_extract_node *node = ex->root;
+    for (; path < end;) {
+      ++path; // '/'
+      char *token = tokens;
+      lua_Integer index = path < end && *path != '/' ? 0 : -1;
+      for (; path < end && *path != '/'; ++path) {
+        if (*path == '~' && path + 1 < end && (path[1] == '0' || path[1] == '1')) {
+          *tokens++ = path[1] == '0' ? '~' : '/';
+          ++path;
+        } else {
+          *tokens++ = *path;
+        }
+        if (index >= 0 && *path >= '0' && *path <= '9' && index <= (LUA_MAXINTEGER - 9) / 10) {
+          index = index * 10 + (*path - '0');
+        } else {
+          index = -1;
+        }
+      }
+      if (tokens - token > 1 && *token == '0') {
+        // array indices have no leading zeros
+        index = -1;
+      }
+      struct json_extract_node *c = extract_child(node, token, tokens - token);
+      if (c == NULL) {
+        c = &nodes[used++];
+        c->token = token;
+        c->len = tokens - token;
+        c->index = index;
+        c->result = 0;
+        c->resolved = 0;
+        c->pending = 0;
+        c->parent = node;
+        c->child = NULL;
+        c->next = node->child;
+        node->child = c;
+      } else {
+        tokens = token;
+      }
+      node = c;
+    }
+    ex->alias[i-1] = node->result;
+    if (node->result == 0) {
+      node->result = base + i;
+      for (struct json_extract_node *a = node; a != NULL; a = a->parent) {
+        ++a->pending;
+      }
+    }
+    lua_pop(L, 1);
+  }
+}
+
+static const char *extract_container(lua_State *L, struct json_parser *jp, struct json_extract *ex, struct json_extract_node *node, const char *p);
+
+// p points at the value of node, returns the end of it
+static const char *extract_member(lua_State *L, struct json_parser *jp, struct json_extract *ex, struct json_extract_node *node, const char *p) {
+  const char *e = NULL;
+  if (node->result != 0 && !node->resolved) {
+    e = parse_value(L, jp, p);
+    lua_replace(L, node->result);
+    node->resolved = 1;
+    for (struct json_extract_node *a = node; a != NULL; a = a->parent) {
+      --a->pending;
+    }
+  }
+  if (node->pending > 0 && (*p == '{' || *p == '[')) {
+    return extract_container(L, jp, ex, node, p);
+  }
+  return e != NULL ? e : skip_value(L, jp, p);
+}
+
+static const char *extract_container(lua_State *L, struct json_parser *jp, struct json_extract *ex, struct json_extract_node *node, const char *p) {
+  char close = *p == '{' ? '}' : ']';
+  lua_Integer i = 0;
+  ++p; // '{' or '['
+  p = skip_whitespace(L, jp, p);
+  if (*p == close) {
+    return p + 1;
+  }
+  for (;*p;) {
+    struct json_extract_node *c;
+    if (close == '}') {
+      if (*p != '"') {
+        json_parse_error(L, *p, "'\"'");
+      }
+      const char *k = p + 1;
+      const char *e = skip_string(L, p);
+      size_t rawlen = e - k - 1;
+      if (memchr(k, '\\', rawlen) == NULL) {
+        c = extract_child(node, k, rawlen);
+      } else {
+        size_t len;
+        parse_string(L, jp, p);
+        const char *s = lua_tolstring(L, -1, &len);
+        c = extract_child(node, s, len);
+        lua_pop(L, 1);
+      }
+      p = skip_whitespace(L, jp, e);
+      if (*p != ':') {
+        json_parse_error(L, *p, "':'");
+      }
+      ++p; // ':'
+      p = skip_whitespace(L, jp, p);
+    } else {
+      for (c = node->child; c != NULL && c->index != i; c = c->next);
+      ++i;
+    }
+    p = c != NULL && c->pending > 0 ? extract_member(L, jp, ex, c, p) : skip_value(L, jp, p);
+    if (ex->root->pending == 0) {
+      return p;
+    }
+    if (node->pending == 0) {
+      return skip_nested(L, p, 1);
+    }
+    p = skip_whitespace(L, jp, p);
+    if (*p != ',') {
+      break;
+    }
+    ++p; // ','
+    p = skip_whitespace(L, jp, p);
+  }
+  if (*p != close) {
+    json_parse_error(L, *p, close == '}' ? "'}' or ','" : "']' or ','");
+  }
+  return p + 1;
+}
+
+// json.Extract(data, pointers) returns the value at each pointer, nil where
+// there is none; a repeated member name resolves to its first occurrence
+static int l_encoding_json_extract(lua_State *L) {
+  size_t len;
+  const char *data = luaL_checklstring(L, 1, &len);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  int n = (int)lua_rawlen(L, 2);
+  lua_settop(L, 2);
+  luaL_checkstack(L, n + LUA_MINSTACK, "too many JSON pointers");
+  struct json_extract ex;
+  compile_extract(L, &ex, 2, n, 3);
+  for (int i = 0; i < n; ++i) {
+    lua_pushnil(L);
+  }
+  struct json_parser parser = {data, data + len, NULL, 0};
+  struct json_parser *jp = &parser;
+  const char *p = skip_whitespace(L, jp, data);
+  if (ex.root->pending > 0) {
+    p = extract_member(L, jp, &ex, ex.root, p);
+    if (ex.root->pending > 0) {
+      p = skip_whitespace(L, jp, p);
+      if (*p) {
+        json_parse_error(L, *p, "'\\0'");
+      }
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    if (ex.alias[i] != 0) {
+      lua_pushvalue(L, ex.alias[i]);
+      lua_replace(L, 4 + i);
+    }
+  }
+  return n;
+}
+
+// Decoders take input in arbitrary chunks. A small scanner that only tracks
+// nesting depth, strings and escapes finds where each top-level value ends,
+// resuming where the previous chunk stopped, and the complete value is then
+// handed to the regular parser.
+
+enum {
+  DECODER_IDLE,
+  DECODER_CONTAINER,
+  DECODER_STRING,
+  DECODER_SCALAR,
+};
+
+struct json_decoder {
+  char *buf;
+  size_t len;
+  size_t cap;
+  size_t start; // first byte of the value being scanned
+  size_t pos;   // next byte to scan
+  size_t depth;
+  int state;
+  int in_string;
+  int escape;
+  int closed;
+  struct json_key_cache keys; // kept across values, anchored in the user value
+};
+
+static const unsigned char scalar_delimiter[256] = {
+  [' '] = 1, ['\n'] = 1, ['\r'] = 1, ['\t'] = 1,
+  [','] = 1, [':'] = 1, ['"'] = 1, ['{'] = 1, ['}'] = 1, ['['] = 1, [']'] = 1,
+};
+
+// returns 1 once buf[start, pos) holds a complete value
+static int decoder_scan(struct json_decoder *dec) {
+  const char *b = dec->buf;
+  size_t pos = dec->pos;
+  size_t len = dec->len;
+  if (dec->state == DECODER_IDLE) {
+    for (; pos < len; ++pos) {
+      char c = b[pos];
+      if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+        break;
+      }
+    }
+    dec->start = pos;
+    if (pos == len) {
+      dec->pos = pos;
+      return 0;
+    }
+    switch (b[pos]) {
+    case '{':
+    case '[':
+      dec->state = DECODER_CONTAINER;
+      dec->depth = 0;
+      dec->in_string = 0;
+      dec->escape = 0;
+      break;
+    case '"':
+      dec->state = DECODER_STRING;
+      dec->escape = 0;
+      ++pos;
+      break;
+    case '}':
+    case ']':
+    case ',':
+    case ':':
+      // let the parser report the stray character
+      dec->pos = pos + 1;
+      return 1;
+    default:
+      dec->state = DECODER_SCALAR;
+      break;
+    }
+  }
+  int done = 0;
+  switch (dec->state) {
+  case DECODER_CONTAINER:
+    for (; pos < len && !done; ++pos) {
+      char c = b[pos];
+      if (dec->in_string) {
+        if (dec->escape) {
+          dec->escape = 0;
+        } else if (c == '\\') {
+          dec->escape = 1;
+        } else if (c == '"') {
+          dec->in_string = 0;
+        }
+      } else if (c == '"') {
+        dec->in_string = 1;
+      } else if (c == '{' || c == '[') {
+        ++dec->depth;
+      } else if (c == '}' || c == ']') {
+        done = --dec->depth == 0;
+      }
+    }
+    break;
+  case DECODER_STRING:
+    for (; pos < len && !done; ++pos) {
+      char c = b[pos];
+      if (dec->escape) {
+        dec->escape = 0;
+      } else if (c == '\\') {
+        dec->escape = 1;
+      } else if (c == '"') {
+        done = 1;
+      }
+    }
+    break;
+  case DECODER_SCALAR:
+    for (; pos < len && !scalar_delimiter[(unsigned char)b[pos]]; ++pos);
+    // a number may continue in the next chunk
+    done = pos < len || dec->closed;
+    break;
+  }
+  dec->pos = pos;
+  return done;
+}
+
+static int l_encoding_json_decoder_feed(lua_State *L) {
+  struct json_decoder *dec = luaL_checkudata(L, 1, ENCODING_JSON_DECODER_METATABLE);
+  size_t len;
+  const char *chunk = luaL_checklstring(L, 2, &len);
+  if (dec->closed) {
+    luaL_error(L, "feed on closed decoder");
+  }
+  if (dec->start > 0 && dec->start >= dec->len / 2) {
+    // drop consumed input before growing
+    memmove(dec->buf, dec->buf + dec->start, dec->len - dec->start);
+    dec->len -= dec->start;
+    dec->pos -= dec->start;
+    dec->start = 0;
+  }
+  if (dec->cap - dec->len < len + 1) {
+    size_t cap = dec->cap ? dec->cap : 4096;
+    for (; cap - dec->len < len + 1; cap *= 2);
+    char *buf = realloc(dec->buf, cap);
+    if (buf == NULL) {
+      luaL_error(L, "failed to grow decoder buffer");
+    }
+    dec->buf = buf;
+    dec->cap = cap;
+  }
+  memcpy(dec->buf + dec->len, chunk, len);
+  dec->len += len;
+  return 0;
+}
+
+// returns true and the next value, or false when more input is needed
+static int l_encoding_json_decoder_next(lua_State *L) {
+  struct json_decoder *dec = luaL_checkudata(L, 1, ENCODING_JSON_DECODER_METATABLE);
+  if (!decoder_scan(dec)) {
+    if (dec->closed && dec->state != DECODER_IDLE) {
+      dec->state = DECODER_IDLE;
+      dec->start = dec->pos;
+      luaL_error(L, "unexpected end of JSON input");
+    }
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  size_t start = dec->start;
+  size_t len = dec->pos - start;
+  // the value is consumed even when it fails to parse
+  dec->state = DECODER_IDLE;
+  dec->start = dec->pos;
+  lua_pushboolean(L, 1);
+  const char *data = lua_pushlstring(L, dec->buf + start, len);
+  lua_getuservalue(L, 1);
+  dec->keys.table = lua_gettop(L);
+  parse_document(L, data, len, &dec->keys, NULL);
+  lua_replace(L, -3);
+  lua_pop(L, 1);
+  return 2;
+}
+
+// marks the end of input so that a trailing number can complete
+static int l_encoding_json_decoder_close(lua_State *L) {
+  struct json_decoder *dec = luaL_checkudata(L, 1, ENCODING_JSON_DECODER_METATABLE);
+  dec->closed = 1;
+  return 0;
+}
+
+static int l_encoding_json_decoder_gc(lua_State *L) {
+  struct json_decoder *dec = luaL_checkudata(L, 1, ENCODING_JSON_DECODER_METATABLE);
+  free(dec->buf);
+  dec->buf = NULL;
+  return 0;
+}
+
+static int l_encoding_json_new_decoder(lua_State *L) {
+  struct json_decoder *dec = lua_newuserdata(L, sizeof(*dec));
+  memset(dec, 0, sizeof(*dec));
+  dec->state = DECODER_IDLE;
+  lua_createtable(L, JSON_KEY_CACHE_SIZE, 0);
+  lua_setuservalue(L, -2);
+  luaL_getmetatable(L, ENCODING_JSON_DECODER_METATABLE);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// Compiled codecs handle one fixed object shape. json.Compile takes a list
+// of {name, type} pairs, where type is "string", "number", "integer",
+// "boolean", "any", or a nested schema or codec. Encoding writes each field
+// with its precomputed ',"name":' prefix; decoding matches keys by length
+// and memcmp, trying the field after the previous match first. Names and
+// prefixes point into Lua strings anchored in the codec's user value.
+
+enum {
+  CODEC_STRING,
+  CODEC_NUMBER,
+  CODEC_INTEGER,
+  CODEC_BOOLEAN,
+  CODEC_ANY,
+  CODEC_OBJECT,
+};
+
+static const char *const codec_type_names[] = {
+  "string", "number", "integer", "boolean", "any", NULL,
+};
+
+struct json_codec;
+
+struct json_codec_field {
+  const char *name;
+  size_t len;
+  const char *prefix; // ',"name":'
+  size_t prefix_len;
+  int type;
+  struct json_codec *codec;
+};
+
+struct json_codec {
+  size_t n;
+  struct json_codec_field fields[1];
+};
+
+static struct json_codec *compile_codec(lua_State *L, int idx) {
+  idx = lua_absindex(L, idx);
+  size_t n = lua_rawlen(L, idx);
+  struct json_codec *codec = lua_newuserdata(L, sizeof(*codec) + n * sizeof(codec->fields[0]));
+  codec->n = n;
+  luaL_getmetatable(L, ENCODING_JSON_CODEC_METATABLE);
+  lua_setmetatable(L, -2);
+  lua_createtable(L, 3 * n, 0);
+  int anchors = lua_gettop(L);
+  lua_Integer anchored = 0;
+  for (size_t i = 0; i < n; ++i) {
+    struct json_codec_field *f = &codec->fields[i];
+    if (lua_rawgeti(L, idx, i + 1) != LUA_TTABLE) {
+      luaL_error(L, "invalid schema field #%d", (int)i + 1);
+    }
+    if (lua_rawgeti(L, -1, 1) != LUA_TSTRING) {
+      luaL_error(L, "schema field #%d has no name", (int)i + 1);
+    }
+    f->name = lua_tolstring(L, -1, &f->len);
+    struct json_writer w;
+    writer_init(L, &w);
+    writer_addchar(&w, ',');
+    stringify_string(L, &w, -2);
+    writer_addchar(&w, ':');
+    lua_pushlstring(L, w.buf, w.n);
+    f->prefix = lua_tolstring(L, -1, &f->prefix_len);
+    lua_rawseti(L, anchors, ++anchored);
+    lua_pop(L, 1); // writer
+    lua_rawseti(L, anchors, ++anchored);
+    f->codec = NULL;
+    lua_rawgeti(L, -1, 2);
+    if (lua_type(L, -1) == LUA_TSTRING) {
+      const char *name = lua_tostring(L, -1);
+      for (f->type = 0; codec_type_names[f->type] != NULL && strcmp(codec_type_names[f->type], name) != 0; ++f->type);
+      if (codec_type_names[f->type] == NULL) {
+        luaL_error(L, "schema field '%s' has an invalid type '%s'", f->name, name);
+      }
+      lua_pop(L, 1);
+    } else if (luaL_testudata(L, -1, ENCODING_JSON_CODEC_METATABLE) != NULL) {
+      f->type = CODEC_OBJECT;
+      f->codec = lua_touserdata(L, -1);
+      lua_rawseti(L, anchors, ++anchored);
+    } else if (lua_type(L, -1) == LUA_TTABLE) {
+      f->type = CODEC_OBJECT;
+      f->codec = compile_codec(L, -1);
+      lua_rawseti(L, anchors, ++anchored);
+      lua_pop(L, 1);
+    } else {
+      luaL_error(L, "schema field '%s' has an invalid type", f->name);
+    }
+    lua_pop(L, 1);
+  }
+  lua_setuservalue(L, -2);
+  return codec;
+}
+
+static void codec_type_error(lua_State *L, struct json_codec_field *f, const char *expected) {
+  luaL_error(L, "field '%s' expects %s, got %s", f->name, expected, luaL_typename(L, -1));
+}
+
+static void codec_encode(lua_State *L, struct json_writer *w, struct json_codec *codec, int idx) {
+  idx = lua_absindex(L, idx);
+  size_t first = 1;
+  writer_addchar(w, '{');
+  for (size_t i = 0; i < codec->n; ++i) {
+    struct json_codec_field *f = &codec->fields[i];
+    int type = lua_getfield(L, idx, f->name);
+    if (type == LUA_TNIL) {
+      lua_pop(L, 1);
+      continue;
+    }
+    writer_addlstring(w, f->prefix + first, f->prefix_len - first);
+    first = 0;
+    switch (f->type) {
+    case CODEC_STRING:
+      if (type != LUA_TSTRING) {
+        codec_type_error(L, f, "string");
+      }
+      stringify_string(L, w, -1);
+      break;
+    case CODEC_NUMBER:
+      if (type != LUA_TNUMBER) {
+        codec_type_error(L, f, "number");
+      }
+      stringify_number(L, w, -1);
+      break;
+    case CODEC_INTEGER:
+      if (!lua_isinteger(L, -1)) {
+        codec_type_error(L, f, "integer");
+      }
+      stringify_number(L, w, -1);
+      break;
+    case CODEC_BOOLEAN:
+      if (type != LUA_TBOOLEAN) {
+        codec_type_error(L, f, "boolean");
+      }
+      writer_addstring(w, lua_toboolean(L, -1) ? "true" : "false");
+      break;
+    case CODEC_ANY:
+      stringify_value(L, w, -1);
+      break;
+    case CODEC_OBJECT:
+      if (type != LUA_TTABLE) {
+        codec_type_error(L, f, "table");
+      }
+      codec_encode(L, w, f->codec, -1);
+      break;
+    }
+    lua_pop(L, 1);
+  }
+  writer_addchar(w, '}');
+}
+
+static struct json_codec_field *codec_find(struct json_codec *codec, const char *key, size_t len, size_t *hint) {
+  for (size_t i = 0, j = *hint; i < codec->n; ++i, ++j) {
+    if (j == codec->n) {
+      j = 0;
+    }
+    struct json_codec_field *f = &codec->fields[j];
+    if (f->len == len && memcmp(f->name, key, len) == 0) {
+      *hint = j + 1;
+      return f;
+    }
+  }
+  return NULL;
+}
+
+static const char *codec_decode(lua_State *L, struct json_parser *jp, struct json_codec *codec, const char *p);
+
+static const char *codec_decode_field(lua_State *L, struct json_parser *jp, struct json_codec_field *f, const char *p) {
+  switch (f->type) {
+  case CODEC_STRING:
+    if (*p != '"') {
+      json_parse_error(L, *p, "'\"'");
+    }
+    return parse_string(L, jp, p);
+  case CODEC_NUMBER:
+  case CODEC_INTEGER:
+    if (*p != '-' && !is_digit(*p)) {
+      json_parse_error(L, *p, "'-' or '0'-'9'");
+    }
+    p = parse_number(L, jp, p);
+    if (f->type == CODEC_INTEGER && !lua_isinteger(L, -1)) {
+      codec_type_error(L, f, "integer");
+    }
+    return p;
+  case CODEC_BOOLEAN:
+    if (*p == 't') {
+      return parse_true(L, jp, p);
+    } else if (*p == 'f') {
+      return parse_false(L, jp, p);
+    }
+    json_parse_error(L, *p, "'t' or 'f'");
+    break;
+  case CODEC_OBJECT:
+    return codec_decode(L, jp, f->codec, p);
+  }
+  return parse_value(L, jp, p);
+}
+
+static const char *codec_decode(lua_State *L, struct json_parser *jp, struct json_codec *codec, const char *p) {
+  if (*p != '{') {
+    json_parse_error(L, *p, "'{'");
+  }
+  ++p; // '{'
+  lua_createtable(L, 0, (int)codec->n);
+  p = skip_whitespace(L, jp, p);
+  if (*p == '}') {
+    ++p; // '}'
+    return p;
+  }
+  size_t hint = 0;
+  for (;;) {
+    if (*p != '"') {
+      json_parse_error(L, *p, "'\"'");
+    }
+    struct json_codec_field *f;
+    const char *key = p + 1;
+    size_t keylen = json_plain_run(key, jp->end - key, '"');
+    if (key[keylen] == '"') {
+      f = codec_find(codec, key, keylen, &hint);
+      p = key + keylen + 1;
+    } else {
+      // escaped or non-ASCII key
+      p = parse_string(L, jp, p);
+      key = lua_tolstring(L, -1, &keylen);
+      f = codec_find(codec, key, keylen, &hint);
+      lua_pop(L, 1);
+    }
+    p = skip_whitespace(L, jp, p);
+    if (*p != ':') {
+      json_parse_error(L, *p, "':'");
+    }
+    ++p; // ':'
+    p = skip_whitespace(L, jp, p);
+    if (f == NULL) {
+      p = skip_value(L, jp, p);
+    } else if (*p == 'n') {
+      p = parse_null(L, jp, p);
+      lua_pop(L, 1);
+    } else {
+      p = codec_decode_field(L, jp, f, p);
+      lua_setfield(L, -2, f->name);
+    }
+    p = skip_whitespace(L, jp, p);
+    if (*p == ',') {
+      ++p; // ','
+      p = skip_whitespace(L, jp, p);
+    } else if (*p == '}') {
+      ++p; // '}'
+      return p;
+    } else {
+      json_parse_error(L, *p, "'}' or ','");
+    }
+  }
+}
+
+static int l_encoding_json_codec_encode(lua_State *L) {
+  struct json_codec *codec = luaL_checkudata(L, 1, ENCODING_JSON_CODEC_METATABLE);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  struct json_writer w;
+  writer_init(L, &w);
+  codec_encode(L, &w, codec, 2);
+  lua_pushlstring(L, w.buf, w.n);
+  return 1;
+}
+
+static int l_encoding_json_codec_decode(lua_State *L) {
+  struct json_codec *codec = luaL_checkudata(L, 1, ENCODING_JSON_CODEC_METATABLE);
+  size_t len;
+  const char *data = luaL_checklstring(L, 2, &len);
+  struct json_parser parser = {data, data + len, NULL, 0};
+  struct json_parser *jp = &parser;
+  data = skip_whitespace(L, jp, data);
+  data = codec_decode(L, jp, codec, data);
+  data = skip_whitespace(L, jp, data);
+  if (*data) {
+    json_parse_error(L, *data, "'\\0'");
+  }
+  return 1;
+}
+
+static int l_encoding_json_compile(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  compile_codec(L, 1);
+  return 1;
+}
+
+// Batch parsing of newline-delimited JSON. The blob is split at newlines
+// into one range per thread, and each worker parses its lines without
+// touching the lua_State into a tape: a flat array of 64-bit words with the
+// type in the top byte. Strings without escapes point into the blob and
+// escaped ones into the worker's arena; numbers take a second word, and
+// containers carry their member count so tables can be pre-sized. The
+// calling thread then turns the tapes into Lua values in line order.
+
+#define JSON_LINES_MAX_THREADS 64
+#define JSON_LINES_MIN_RANGE (64 * 1024)
+#define JSON_TAPE_MAX_DEPTH 1024
+
+enum {
+  TAPE_NULL,
+  TAPE_TRUE,
+  TAPE_FALSE,
+  TAPE_INTEGER,
+  TAPE_FLOAT,
+  TAPE_STRING,         // offset into the blob, then the length
+  TAPE_ESCAPED_STRING, // offset into the arena, then the length
+  TAPE_ARRAY,          // element count, then the elements
+  TAPE_OBJECT,         // member count, then key and value per member
+};
+
+#define TAPE_WORD(type, payload) ((uint64_t)(type) << 56 | (uint64_t)(payload))
+#define TAPE_TYPE(w) ((int)((w) >> 56))
+#define TAPE_PAYLOAD(w) ((w) & (((uint64_t)1 << 56) - 1))
+
+struct json_tape {
+  const char *data;   // the whole blob
+  const char *begin;  // this worker's lines
+  const char *end;
+  uint64_t *words;
+  size_t n, cap;
+  char *arena;
+  size_t arena_len, arena_cap;
+  size_t values;      // non-blank lines parsed
+  size_t line;        // newlines passed so far
+  // first error, if any
+  const char *error_at;
+  const char *expect;
+  const char *message;
+};
+
+struct json_lines {
+  size_t n;
+  struct json_tape tapes[JSON_LINES_MAX_THREADS];
+};
+
+static int tape_reserve(struct json_tape *t, size_t words) {
+  if (t->cap - t->n >= words) {
+    return 1;
+  }
+  size_t cap = t->cap ? t->cap * 2 : 1024;
+  uint64_t *p = realloc(t->words, cap * sizeof(*p));
+  if (p == NULL) {
+    t->message = "not enough memory";
+    return 0;
+  }
+  t->words = p;
+  t->cap = cap;
+  return 1;
+}
+
+static int tape_append(struct json_tape *t, const char *s, size_t len) {
+  if (t->arena_cap - t->arena_len < len) {
+    size_t cap = t->arena_cap ? t->arena_cap * 2 : 4096;
+    while (cap - t->arena_len < len) {
+      cap *= 2;
     }
-    ++p; // ':'
-    p = skip_whitespace(L, p);
-    p = parse_value(L, p);
-    p = skip_whitespace(L, p);
-    lua_settable(L, -3);
-    if (*p != ',') {
-      break;
+    char *p = realloc(t->arena, cap);
+    if (p == NULL) {
+      t->message = "not enough memory";
+      return 0;
     }
-    ++p; // ','
-    p = skip_whitespace(L, p);
-  }
-  if (*p != '}') {
-    json_parse_error(L, *p, "'}' or ','");
+    t->arena = p;
+    t->arena_cap = cap;
   }
-  ++p; // '}'
-  return p;
+  memcpy(t->arena + t->arena_len, s, len);
+  t->arena_len += len;
+  return 1;
 }
 
-static const char *parse_array(lua_State *L, const char *p) {
-  ++p; // '['
-  lua_newtable(L);
-  p = skip_whitespace(L, p);
-  if (*p == ']') {
-    ++p; // ']'
-    return p;
-  }
-  size_t idx = 1;
-  for (;*p;) {
-    p = parse_value(L, p);
-    p = skip_whitespace(L, p);
-    lua_seti(L, -2, idx++);
-    if (*p != ',') {
-      break;
-    }
-    ++p; // ','
-    p = skip_whitespace(L, p);
-  }
-  if (*p != ']') {
-    json_parse_error(L, *p, "']' or ','");
+static const char *tape_error(struct json_tape *t, const char *p, const char *expect) {
+  t->error_at = p;
+  t->expect = expect;
+  return NULL;
+}
+
+// unlike skip_whitespace this stops at '\n', which ends the line
+static const char *tape_skip_whitespace(const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r') {
+    ++p;
   }
-  ++p; // ']'
   return p;
 }
 
-static const char *parse_string(lua_State *L, const char *p) {
+static const char *tape_string(struct json_tape *t, const char *p) {
   ++p; // '"'
-  if (*p == '"') {
-    ++p; // '"'
-    lua_pushlstring(L, "", 0);
-    return p;
-  }
-  luaL_Buffer buf;
-  luaL_buffinit(L, &buf);
-  for (;*p;) {
-    if (*p == '\\') { // escape
-      ++p; // '\'
-      switch (*p) {
-      case '"':
-      case '\\':
-      case '/':
-        luaL_addchar(&buf, *p);
-        break;
-      case 'b':
-        luaL_addchar(&buf, '\b');
-        break;
-      case 'f':
-        luaL_addchar(&buf, '\f');
-        break;
-      case 'n':
-        luaL_addchar(&buf, '\n');
-        break;
-      case 'r':
-        luaL_addchar(&buf, '\r');
-        break;
-      case 't':
-        luaL_addchar(&buf, '\t');
-        break;
-      case 'u':
-        break;
-      default:
-        json_parse_error(L, *p, "'\"' or '\' or '/' or 'b' or 'f' or 'n' or 'r' or 't' or 'u' hex hex hex hex");
+  const char *start = p;
+  const char *run = p;
+  size_t arena_start = t->arena_len;
+  int escaped = 0;
+  for (;;) {
+    p += json_plain_run(p, t->end - p, '"');
+    if ((unsigned char)*p >= 0x80) {
+      size_t n = utf8_sequence(p, t->end - p);
+      if (n == 0) {
+        return tape_error(t, p, "U+0020~U+10FFFF");
       }
-      if (*p != 'u') {
-        ++p; // escape
-      } else {
-        ++p; // 'u'
-        int code = 0;
-        for (int i = 0; i < 4; ++i) {
-          char c = p[i];
-          char v = 0;
-          if (c >= '0' && c <= '9') {
-            v = c - '0';
-          } else if (c >= 'A' && c <= 'F') {
-            v = c - 'A' + 10;
-          } else if (c >= 'a' && c <= 'f') {
-            v = c - 'a' + 10;
-          } else {
-            json_parse_error(L, c, "'0'-'9' or 'a'-'f' or 'A'-'F'");
-          }
-          code <<= 4;
-          code |= v;
-        }
-        luaL_addchar(&buf, (code>>12) | 0xE0);
-        luaL_addchar(&buf, ((code>>6) & 0x3F) | 0x80);
-        luaL_addchar(&buf, (code&0x3F) | 0x80);
-        p += 4;
-      }
-    } else if ((unsigned char)*p >= 0x20) {
-      if (((unsigned char)p[0]>>7) == 0) {
-        luaL_addchar(&buf, *p++);
-      } else if (((unsigned char)p[0]>>5) == 0x6 &&
-                 ((unsigned char)p[1]>>6) == 0x2) {
-        luaL_addchar(&buf, *p++);
-        luaL_addchar(&buf, *p++);
-      } else if (((unsigned char)p[0]>>4) == 0xE &&
-                 ((unsigned char)p[1]>>6) == 0x2 &&
-                 ((unsigned char)p[2]>>6) == 0x2) {
-        luaL_addchar(&buf, *p++);
-        luaL_addchar(&buf, *p++);
-        luaL_addchar(&buf, *p++);
-      } else if (((unsigned char)p[0]>>4) == 0x1E &&
-                 ((unsigned char)p[1]>>6) == 0x2 &&
-                 ((unsigned char)p[2]>>6) == 0x2 &&
-                 ((unsigned char)p[3]>>6) == 0x2) {
-        luaL_addchar(&buf, *p++);
-        luaL_addchar(&buf, *p++);
-        luaL_addchar(&buf, *p++);
-        luaL_addchar(&buf, *p++);
-      } else {
-        json_parse_error(L, *p, "U+0020~U+10FFFF");
+      p += n;
+    } else if (*p == '\\') {
+      char out[4];
+      const char *expect = NULL;
+      if (!tape_append(t, run, p - run)) {
+        return NULL;
       }
-    } else {
-      json_parse_error(L, *p, "U+0020~U+10FFFF");
-    }
-    if (*p == '"') {
+      size_t n = scan_escape(p, &p, &expect, out);
+      if (n == 0) {
+        return tape_error(t, p, expect);
+      }
+      if (!tape_append(t, out, n)) {
+        return NULL;
+      }
+      run = p;
+      escaped = 1;
+    } else if (*p == '"') {
       break;
+    } else if (*p == '\0' || *p == '\n') {
+      return tape_error(t, p, "'\"'");
+    } else {
+      return tape_error(t, p, "U+0020~U+10FFFF");
     }
   }
-  if (*p != '"') {
-    json_parse_error(L, *p, "'\"'");
+  if (!tape_reserve(t, 2)) {
+    return NULL;
   }
-  ++p; // '"'
-  luaL_pushresult(&buf);
-  return p;
-}
-
-static const char *parse_number_e(lua_State *L, const char *p, double *mul) {
-  ++p; // 'e' or 'E'
-  int signmul = 1;
-  if (*p == '-') {
-    ++p; // '-'
-    signmul = -1;
-  } else if (*p == '+') {
-    ++p; // '+'
-  } else if (*p <= '0' || *p >= '9') {
-    json_parse_error(L, *p, "'-' or '+' or '0'-'9'");
-  }
-  long idxnum = 0;
-  for (;*p == '0';);
-  for (;*p >= '0' && *p <= '9';) {
-    idxnum *= 10;
-    idxnum += *p++ - '0';
-  }
-  idxnum *= signmul;
-  *mul = pow(10, idxnum);
-  return p;
-}
-
-static const char *parse_number_decimal(lua_State *L, const char *p, double *decimal) {
-  double val = 0;
-  ++p; // '.'
-  if (*p >= '0' && *p <= '9') {
-    double mul = 1;
-    for (;*p >= '0' && *p <= '9';) {
-      mul *= 0.1;
-      val *= 10;
-      val += *p++ - '0';
+  if (escaped) {
+    if (!tape_append(t, run, p - run)) {
+      return NULL;
     }
-    val *= mul;
+    t->words[t->n++] = TAPE_WORD(TAPE_ESCAPED_STRING, arena_start);
+    t->words[t->n++] = t->arena_len - arena_start;
   } else {
-    json_parse_error(L, *p, "'0'-'9'");
+    t->words[t->n++] = TAPE_WORD(TAPE_STRING, start - t->data);
+    t->words[t->n++] = p - start;
   }
-  *decimal = val;
+  ++p; // '"'
   return p;
 }
 
-static const char *parse_number(lua_State *L, const char *p) {
-  int signmul = 1;
-  long integer_value = 0;
-  double number_value = 0;
-  if (*p == '-') {
-    signmul = -1;
-    ++p; // '-'
-  }
-  if (*p == '0') {
-    ++p; // '0'
-    if (*p == '.') {
-      double decimal;
-      p = parse_number_decimal(L, p, &decimal);
-      number_value += decimal;
-      if (*p == 'e' || *p == 'E') {
-        double idxmul;
-        p = parse_number_e(L, p, &idxmul);
-        number_value *= idxmul;
-      }
-      lua_pushnumber(L, number_value * signmul);
-    } else if (*p == 'e' || *p == 'E') {
-      ++p; // 'e' or 'E'
-      if (*p == '-' || *p == '+') {
-        ++p; // '-' or '+'
-      }
-      for (;*p >= '0' && *p <= '9';) {
-        ++p;
-      }
-      lua_pushnumber(L, 0);
-    } else {
-      lua_pushinteger(L, 0);
-    }
-  } else { // 1-9
-    for (;*p >= '0' && *p <= '9';) {
-      integer_value *= 10;
-      integer_value += *p++ - '0';
-    }
-    if (*p == '.') {
-      number_value = integer_value;
-      double decimal;
-      p = parse_number_decimal(L, p, &decimal);
-      number_value += decimal;
-      if (*p == 'e' || *p == 'E') {
-        double idxmul;
-        p = parse_number_e(L, p, &idxmul);
-        number_value *= idxmul;
-      }
-      lua_pushnumber(L, number_value * signmul);
-    } else if (*p == 'e' || *p == 'E') {
-      number_value = integer_value;
-      double idxmul;
-      p = parse_number_e(L, p, &idxmul);
-      number_value *= idxmul;
-      lua_pushnumber(L, number_value * signmul);
-    } else {
-      lua_pushinteger(L, integer_value * signmul);
+static const char *tape_literal(struct json_tape *t, const char *p, const char *word, int type) {
+  for (const char *w = word; *w; ++w, ++p) {
+    if (*p != *w) {
+      return tape_error(t, p, word);
     }
   }
-  return p;
-}
-
-static const char *parse_true(lua_State *L, const char *p) {
-  if (*p++ != 't' ||
-      *p++ != 'r' ||
-      *p++ != 'u' ||
-      *p++ != 'e') {
-    json_parse_error(L, *(p-1), "true");
+  if (!tape_reserve(t, 1)) {
+    return NULL;
   }
-  lua_pushboolean(L, 1);
+  t->words[t->n++] = TAPE_WORD(type, 0);
   return p;
 }
 
-static const char *parse_false(lua_State *L, const char *p) {
-  if (*p++ != 'f' ||
-      *p++ != 'a' ||
-      *p++ != 'l' ||
-      *p++ != 's' ||
-      *p++ != 'e') {
-    json_parse_error(L, *(p-1), "false");
-  }
-  lua_pushboolean(L, 0);
-  return p;
-}
+static const char *tape_value(struct json_tape *t, const char *p, int depth);
 
-static const char *parse_null(lua_State *L, const char *p) {
-  if (*p++ != 'n' ||
-      *p++ != 'u' ||
-      *p++ != 'l' ||
-      *p++ != 'l') {
-    json_parse_error(L, *(p-1), "null");
+static const char *tape_container(struct json_tape *t, const char *p, int depth) {
+  int object = *p == '{';
+  char close = object ? '}' : ']';
+  if (depth >= JSON_TAPE_MAX_DEPTH) {
+    t->message = "exceeded maximum nesting depth";
+    return NULL;
   }
-  lua_pushnil(L);
+  if (!tape_reserve(t, 1)) {
+    return NULL;
+  }
+  size_t at = t->n++;
+  size_t count = 0;
+  ++p; // '{' or '['
+  p = tape_skip_whitespace(p);
+  if (*p != close) {
+    for (;;) {
+      if (object) {
+        if (*p != '"') {
+          return tape_error(t, p, "'\"'");
+        }
+        if ((p = tape_string(t, p)) == NULL) {
+          return NULL;
+        }
+        p = tape_skip_whitespace(p);
+        if (*p != ':') {
+          return tape_error(t, p, "':'");
+        }
+        ++p; // ':'
+        p = tape_skip_whitespace(p);
+      }
+      if ((p = tape_value(t, p, depth + 1)) == NULL) {
+        return NULL;
+      }
+      ++count;
+      p = tape_skip_whitespace(p);
+      if (*p == ',') {
+        ++p; // ','
+        p = tape_skip_whitespace(p);
+      } else if (*p == close) {
+        break;
+      } else {
+        return tape_error(t, p, object ? "'}' or ','" : "']' or ','");
+      }
+    }
+  }
+  ++p; // '}' or ']'
+  t->words[at] = TAPE_WORD(object ? TAPE_OBJECT : TAPE_ARRAY, count);
   return p;
 }
 
-static const char *parse_value(lua_State *L, const char *p) {
+static const char *tape_value(struct json_tape *t, const char *p, int depth) {
   switch (*p) {
   case '{':
-    return parse_object(L, p);
   case '[':
-    return parse_array(L, p);
+    return tape_container(t, p, depth);
   case '"':
-    return parse_string(L, p);
+    return tape_string(t, p);
   case '-':
   case '0':
   case '1':
@@ -355,202 +4492,321 @@ static const char *parse_value(lua_State *L, const char *p) {
   case '6':
   case '7':
   case '8':
-  case '9':
-    return parse_number(L, p);
+  case '9': {
+    const char *stop;
+    const char *expect = NULL;
+    lua_Integer ival;
+    double dval;
+    int kind = scan_number(p, t->end, &stop, &expect, &ival, &dval);
+    if (kind == NUMBER_ERROR) {
+      return tape_error(t, stop, expect);
+    }
+    if (!tape_reserve(t, 2)) {
+      return NULL;
+    }
+    if (kind == NUMBER_INTEGER) {
+      t->words[t->n++] = TAPE_WORD(TAPE_INTEGER, 0);
+      t->words[t->n++] = (uint64_t)ival;
+    } else {
+      t->words[t->n++] = TAPE_WORD(TAPE_FLOAT, 0);
+      memcpy(&t->words[t->n++], &dval, sizeof(dval));
+    }
+    return stop;
+  }
   case 't':
-    return parse_true(L, p);
+    return tape_literal(t, p, "true", TAPE_TRUE);
   case 'f':
-    return parse_false(L, p);
+    return tape_literal(t, p, "false", TAPE_FALSE);
   case 'n':
-    return parse_null(L, p);
+    return tape_literal(t, p, "null", TAPE_NULL);
   default:
-    json_parse_error(L, *p, "'{' or '[' or '\"' or '-' or '0'-'9' or 't' or 'f' or 'n'");
+    return tape_error(t, p, "'{' or '[' or '\"' or '-' or '0'-'9' or 't' or 'f' or 'n'");
   }
-  return p;
 }
 
-static void stringify_table(lua_State *L, luaL_Buffer *buf, int idx);
-static void stringify_string(lua_State *L, luaL_Buffer *buf, int idx);
-static void stringify_value(lua_State *L, luaL_Buffer *buf, int idx);
-
-static void stringify_table(lua_State *L, luaL_Buffer *buf, int idx) {
-  idx = lua_absindex(L, idx);
-  lua_Unsigned len = lua_rawlen(L, idx);
-  if (len > 0) {
-    luaL_addchar(buf, '[');
-    for (lua_Unsigned i = 0; i < len; ++i) {
-      if (i > 0) {
-        luaL_addchar(buf, ',');
-      }
-      lua_rawgeti(L, idx, i+1);
-      stringify_value(L, buf, -1);
-      lua_pop(L, 1);
-    }
-    luaL_addchar(buf, ']');
-  } else {
-    luaL_addchar(buf, '{');
-    lua_pushnil(L);
-    int begin = 1;
-    while (lua_next(L, idx)) {
-      if (begin == 1) {
-        begin = 0;
-      } else {
-        luaL_addchar(buf, ',');
+static void *tape_run(void *arg) {
+  struct json_tape *t = arg;
+  const char *p = t->begin;
+  while (p < t->end) {
+    p = tape_skip_whitespace(p);
+    if (*p != '\n' && p < t->end) {
+      if ((p = tape_value(t, p, 0)) == NULL) {
+        return NULL;
       }
-      int type = lua_type(L, -2);
-      switch (type) {
-      case LUA_TNIL:
-        luaL_addstring(buf, "\"null\"");
-        break;
-      case LUA_TBOOLEAN:
-        if (lua_toboolean(L, -2)) {
-          luaL_addstring(buf, "\"true\"");
-        } else {
-          luaL_addstring(buf, "\"false\"");
-        }
-        break;
-      case LUA_TNUMBER:
-        luaL_addchar(buf, '"');
-        lua_pushvalue(L, -2);
-        luaL_addvalue(buf);
-        luaL_addchar(buf, '"');
-        break;
-      case LUA_TSTRING:
-        stringify_string(L, buf, -2);
-        break;
-      case LUA_TTABLE:
-      default:
-        goto label_skip;
+      ++t->values;
+      p = tape_skip_whitespace(p);
+      if (*p != '\n' && p < t->end) {
+        tape_error(t, p, "'\\n'");
+        return NULL;
       }
-      luaL_addchar(buf, ':');
-      stringify_value(L, buf, -1);
-label_skip:
-      lua_pop(L, 1);
     }
-    luaL_addchar(buf, '}');
+    if (p < t->end) {
+      ++p; // '\n'
+      ++t->line;
+    }
   }
+  return NULL;
 }
 
-static const char hexmap[] = {
-  '0', '1', '2', '3',
-  '4', '5', '6', '7',
-  '8', '9', 'A', 'B',
-  'C', 'D', 'E', 'F',
-};
-
-static void stringify_string(lua_State *L, luaL_Buffer *buf, int idx) {
-  idx = lua_absindex(L, idx);
-  size_t len;
-  const char *s = lua_tolstring(L, idx, &len);
-  luaL_addchar(buf, '"');
-  for (size_t i = 0; i < len;) {
-    if ((unsigned char)s[i+0] < 0x20) {
-      unsigned char c = s[i+0];
-      if (c == '\b') {
-        luaL_addstring(buf, "\\b");
-      } else if (c == '\f') {
-        luaL_addstring(buf, "\\f");
-      } else if (c == '\n') {
-        luaL_addstring(buf, "\\n");
-      } else if (c == '\r') {
-        luaL_addstring(buf, "\\r");
-      } else if (c == '\t') {
-        luaL_addstring(buf, "\\t");
-      } else {
-        luaL_addstring(buf, "\\u00");
-        luaL_addchar(buf, hexmap[c>>4]);
-        luaL_addchar(buf, hexmap[c&0xF]);
-      }
-      ++i;
-    } else if (((unsigned char)s[i+0]>>7) == 0) {
-      unsigned char c = s[i+0];
-      switch (c) {
-      case '"':
-      case '\\':
-      case '/':
-        luaL_addchar(buf, '\\');
-        break;
-      default:
-        break;
-      }
-      luaL_addchar(buf, s[i++]);
-    } else if (((unsigned char)s[i+0]>>5) == 0x6 &&
-               ((unsigned char)s[i+1]>>6) == 0x2) {
-      luaL_addchar(buf, s[i++]);
-      luaL_addchar(buf, s[i++]);
-    } else if (((unsigned char)s[i+0]>>4) == 0xE &&
-               ((unsigned char)s[i+1]>>6) == 0x2 &&
-               ((unsigned char)s[i+2]>>6) == 0x2) {
-      luaL_addchar(buf, s[i++]);
-      luaL_addchar(buf, s[i++]);
-      luaL_addchar(buf, s[i++]);
-    } else if (((unsigned char)s[i+0]>>4) == 0x1E &&
-               ((unsigned char)s[i+1]>>6) == 0x2 &&
-               ((unsigned char)s[i+2]>>6) == 0x2 &&
-               ((unsigned char)s[i+3]>>6) == 0x2) {
-      luaL_addchar(buf, s[i++]);
-      luaL_addchar(buf, s[i++]);
-      luaL_addchar(buf, s[i++]);
-      luaL_addchar(buf, s[i++]);
-    }
-  }
-  luaL_addchar(buf, '"');
-}
-
-static void stringify_value(lua_State *L, luaL_Buffer *buf, int idx) {
-  idx = lua_absindex(L, idx);
-  int type = lua_type(L, idx);
-  switch (type) {
-  case LUA_TNIL:
-    luaL_addstring(buf, "null");
+static void tape_push(lua_State *L, struct json_tape *t, size_t *i) {
+  uint64_t w = t->words[(*i)++];
+  uint64_t payload = TAPE_PAYLOAD(w);
+  switch (TAPE_TYPE(w)) {
+  case TAPE_NULL:
+    lua_pushnil(L);
     break;
-  case LUA_TBOOLEAN:
-    if (lua_toboolean(L, idx)) {
-      luaL_addstring(buf, "true");
-    } else {
-      luaL_addstring(buf, "false");
-    }
+  case TAPE_TRUE:
+    lua_pushboolean(L, 1);
     break;
-  case LUA_TNUMBER:
-    lua_pushvalue(L, idx);
-    luaL_addvalue(buf);
+  case TAPE_FALSE:
+    lua_pushboolean(L, 0);
     break;
-  case LUA_TSTRING:
-    stringify_string(L, buf, idx);
+  case TAPE_INTEGER:
+    lua_pushinteger(L, (lua_Integer)t->words[(*i)++]);
     break;
-  case LUA_TTABLE:
-    stringify_table(L, buf, idx);
+  case TAPE_FLOAT: {
+    double d;
+    memcpy(&d, &t->words[(*i)++], sizeof(d));
+    lua_pushnumber(L, d);
+    break;
+  }
+  case TAPE_STRING:
+    lua_pushlstring(L, t->data + payload, t->words[(*i)++]);
+    break;
+  case TAPE_ESCAPED_STRING:
+    lua_pushlstring(L, t->arena + payload, t->words[(*i)++]);
+    break;
+  case TAPE_ARRAY:
+    luaL_checkstack(L, 2, "too many nested values");
+    lua_createtable(L, (int)payload, 0);
+    for (uint64_t k = 1; k <= payload; ++k) {
+      tape_push(L, t, i);
+      lua_seti(L, -2, k);
+    }
+    break;
+  case TAPE_OBJECT:
+    luaL_checkstack(L, 3, "too many nested values");
+    lua_createtable(L, 0, (int)payload);
+    for (uint64_t k = 0; k < payload; ++k) {
+      tape_push(L, t, i);
+      tape_push(L, t, i);
+      lua_settable(L, -3);
+    }
     break;
   }
 }
 
-static int l_encoding_json_stringify(lua_State *L) {
-  luaL_Buffer buf;
-  luaL_buffinit(L, &buf);
-  stringify_value(L, &buf, 1);
-  luaL_pushresult(&buf);
-  return 1;
+static void free_lines(struct json_lines *lines) {
+  for (size_t i = 0; i < lines->n; ++i) {
+    free(lines->tapes[i].words);
+    free(lines->tapes[i].arena);
+  }
+  lines->n = 0;
 }
 
-static int l_encoding_json_parse(lua_State *L) {
+static int l_encoding_json_lines_gc(lua_State *L) {
+  free_lines(luaL_checkudata(L, 1, ENCODING_JSON_LINES_METATABLE));
+  return 0;
+}
+
+// json.ParseLines(blob [, opts]) returns a table with the value of every
+// non-blank line and their count; opts.threads sets the number of workers.
+static int l_encoding_json_parse_lines(lua_State *L) {
   size_t len;
-  const char *data = lua_tolstring(L, 1, &len);
-  data = skip_whitespace(L, data);
-  data = parse_value(L, data);
-  data = skip_whitespace(L, data);
-  if (*data) {
-    json_parse_error(L, *data, "'\\0'");
+  const char *data = luaL_checklstring(L, 1, &len);
+  lua_Integer threads = 1;
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "threads");
+    threads = luaL_optinteger(L, -1, 1);
+    luaL_argcheck(L, threads >= 1, 2, "threads must be positive");
+    lua_pop(L, 1);
   }
-  return 1;
+  if (threads > JSON_LINES_MAX_THREADS) {
+    threads = JSON_LINES_MAX_THREADS;
+  }
+  if ((size_t)threads > len / JSON_LINES_MIN_RANGE + 1) {
+    threads = len / JSON_LINES_MIN_RANGE + 1;
+  }
+  struct json_lines *lines = lua_newuserdata(L, sizeof(*lines));
+  memset(lines, 0, sizeof(*lines));
+  luaL_getmetatable(L, ENCODING_JSON_LINES_METATABLE);
+  lua_setmetatable(L, -2);
+  const char *end = data + len;
+  const char *p = data;
+  for (lua_Integer i = 0; i < threads && p < end; ++i) {
+    struct json_tape *t = &lines->tapes[lines->n++];
+    t->data = data;
+    t->begin = p;
+    p = i == threads - 1 ? end : data + len / threads * (i + 1);
+    if (p < t->begin) {
+      p = t->begin;
+    }
+    const char *nl = memchr(p, '\n', end - p);
+    p = nl != NULL ? nl + 1 : end;
+    t->end = p;
+  }
+  pthread_t workers[JSON_LINES_MAX_THREADS];
+  int started[JSON_LINES_MAX_THREADS] = {0};
+  for (size_t i = 1; i < lines->n; ++i) {
+    started[i] = pthread_create(&workers[i], NULL, tape_run, &lines->tapes[i]) == 0;
+  }
+  for (size_t i = 0; i < lines->n; ++i) {
+    if (i == 0 || !started[i]) {
+      tape_run(&lines->tapes[i]);
+    } else {
+      pthread_join(workers[i], NULL);
+    }
+  }
+  size_t count = 0;
+  size_t line = 1;
+  for (size_t i = 0; i < lines->n; ++i) {
+    struct json_tape *t = &lines->tapes[i];
+    line += t->line;
+    if (t->message != NULL) {
+      luaL_error(L, "line %d: %s", (int)line, t->message);
+    }
+    if (t->error_at != NULL) {
+      char c = *t->error_at;
+      luaL_error(L, isprint(c) ? "line %d: " TOKEN_ERROR : "line %d: " TOKEN_ERROR_ASCII, (int)line, c, t->expect);
+    }
+    count += t->values;
+  }
+  lua_createtable(L, (int)count, 0);
+  lua_Integer k = 0;
+  for (size_t i = 0; i < lines->n; ++i) {
+    struct json_tape *t = &lines->tapes[i];
+    for (size_t w = 0; w < t->n;) {
+      tape_push(L, t, &w);
+      lua_seti(L, -2, ++k);
+    }
+  }
+  free_lines(lines);
+  lua_pushinteger(L, k);
+  return 2;
 }
 
+static const luaL_Reg encoding_json_document_methods[] = {
+  {"Get", l_encoding_json_document_get},
+  {"Decode", l_encoding_json_document_decode},
+  {"Items", l_encoding_json_document_items},
+  {NULL, NULL}
+};
+
+static const luaL_Reg encoding_json_decoder_methods[] = {
+  {"Feed", l_encoding_json_decoder_feed},
+  {"Next", l_encoding_json_decoder_next},
+  {"Close", l_encoding_json_decoder_close},
+  {"__gc", l_encoding_json_decoder_gc},
+  {NULL, NULL}
+};
+
+static const luaL_Reg encoding_json_array_methods[] = {
+  {"__index", l_encoding_json_array_index},
+  {"__newindex", l_encoding_json_array_newindex},
+  {"__len", l_encoding_json_array_len},
+  {NULL, NULL}
+};
+
+static const luaL_Reg encoding_json_codec_methods[] = {
+  {"Encode", l_encoding_json_codec_encode},
+  {"Decode", l_encoding_json_codec_decode},
+  {NULL, NULL}
+};
+
 static const luaL_Reg encoding_json_functions[] = {
   {"Stringify", l_encoding_json_stringify},
+  {"StringifyTo", l_encoding_json_stringify_to},
+  {"HashCanonical", l_encoding_json_hash_canonical},
   {"Parse", l_encoding_json_parse},
+  {"ParseFile", l_encoding_json_parse_file},
+  {"Open", l_encoding_json_open},
+  {"Extract", l_encoding_json_extract},
+  {"NewDecoder", l_encoding_json_new_decoder},
+  {"Compile", l_encoding_json_compile},
+  {"ParseLines", l_encoding_json_parse_lines},
   {NULL, NULL}
 };
 
+static void create_encoding_json_index_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_JSON_INDEX_METATABLE);
+  lua_pushcfunction(L, l_encoding_json_index_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+}
+
+static void create_encoding_json_document_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_JSON_DOCUMENT_METATABLE);
+  lua_newtable(L);
+  luaL_setfuncs(L, encoding_json_document_methods, 0);
+  lua_pushcclosure(L, l_encoding_json_document_index, 1);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, l_encoding_json_document_len);
+  lua_setfield(L, -2, "__len");
+  lua_pop(L, 1);
+}
+
+static void create_encoding_json_decoder_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_JSON_DECODER_METATABLE);
+  luaL_setfuncs(L, encoding_json_decoder_methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
+static void create_encoding_json_lines_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_JSON_LINES_METATABLE);
+  lua_pushcfunction(L, l_encoding_json_lines_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+}
+
+static void create_encoding_json_mapping_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_JSON_MAPPING_METATABLE);
+  lua_pushcfunction(L, l_encoding_json_mapping_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+}
+
+static void create_encoding_json_array_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_JSON_ARRAY_METATABLE);
+  luaL_setfuncs(L, encoding_json_array_methods, 0);
+  lua_pop(L, 1);
+}
+
+static void create_encoding_json_codec_metatable(lua_State *L) {
+  luaL_newmetatable(L, ENCODING_JSON_CODEC_METATABLE);
+  luaL_setfuncs(L, encoding_json_codec_methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
+static void select_classifier(void) {
+#ifdef JSON_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    json_classify = classify_avx2;
+    json_plain_run = plain_run_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    json_classify = classify_sse2;
+    json_plain_run = plain_run_sse2;
+  }
+#endif
+}
+
 int luaopen_encoding_json(lua_State *L) {
+  select_classifier();
+  create_encoding_json_index_metatable(L);
+  create_encoding_json_document_metatable(L);
+  create_encoding_json_decoder_metatable(L);
+  create_encoding_json_codec_metatable(L);
+  create_encoding_json_lines_metatable(L);
+  create_encoding_json_mapping_metatable(L);
+  create_encoding_json_array_metatable(L);
   luaL_newlib(L, encoding_json_functions);
+  lua_pushnil(L);
+  lua_pushcclosure(L, l_encoding_json_parse_into, 1);
+  lua_setfield(L, -2, "ParseInto");
   return 1;
 }
\ No newline at end of file
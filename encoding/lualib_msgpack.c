@@ -0,0 +1,416 @@
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include <stdint.h>
+#include <string.h>
+
+// MessagePack with the table rules of json.Stringify: a table with a
+// non-zero raw length is an array of its elements 1..#t, anything else is
+// a map. Map keys keep their type when it is a string, number or boolean,
+// other keys are skipped. Integers use the smallest integer format, floats
+// are always written as float64 so they decode exactly.
+
+#define MSGPACK_INITIAL_SIZE 256
+#define MSGPACK_MAX_DEPTH 1000
+
+// The output lives in a userdata at a fixed stack slot, like the JSON
+// writer, so the traversal can push keys and values above it.
+struct msgpack_writer {
+  lua_State *L;
+  char *buf;
+  size_t n;
+  size_t size;
+  int box;
+  char init[MSGPACK_INITIAL_SIZE];
+};
+
+static void writer_init(lua_State *L, struct msgpack_writer *w) {
+  lua_pushnil(L);
+  w->L = L;
+  w->buf = w->init;
+  w->n = 0;
+  w->size = sizeof(w->init);
+  w->box = lua_gettop(L);
+}
+
+static char *writer_prepsize(struct msgpack_writer *w, size_t sz) {
+  if (w->size - w->n < sz) {
+    size_t size = w->size * 2;
+    if (size < w->n + sz) {
+      size = w->n + sz;
+    }
+    char *buf = (char *)lua_newuserdata(w->L, size);
+    memcpy(buf, w->buf, w->n);
+    lua_replace(w->L, w->box);
+    w->buf = buf;
+    w->size = size;
+  }
+  return w->buf + w->n;
+}
+
+static void writer_addbyte(struct msgpack_writer *w, unsigned char c) {
+  writer_prepsize(w, 1)[0] = (char)c;
+  w->n += 1;
+}
+
+// a type byte followed by the low size bytes of v, big-endian
+static void writer_addheader(struct msgpack_writer *w, unsigned char type, uint64_t v, int size) {
+  unsigned char *out = (unsigned char *)writer_prepsize(w, 1 + size);
+  out[0] = type;
+  for (int i = size; i > 0; --i) {
+    out[i] = (unsigned char)v;
+    v >>= 8;
+  }
+  w->n += 1 + size;
+}
+
+static void writer_addlstring(struct msgpack_writer *w, const char *s, size_t len) {
+  memcpy(writer_prepsize(w, len), s, len);
+  w->n += len;
+}
+
+static void encode_integer(struct msgpack_writer *w, lua_Integer v) {
+  if (v >= 0) {
+    if (v < 0x80) {
+      writer_addbyte(w, (unsigned char)v);
+    } else if (v <= 0xFF) {
+      writer_addheader(w, 0xCC, v, 1);
+    } else if (v <= 0xFFFF) {
+      writer_addheader(w, 0xCD, v, 2);
+    } else if (v <= 0xFFFFFFFF) {
+      writer_addheader(w, 0xCE, v, 4);
+    } else {
+      writer_addheader(w, 0xCF, v, 8);
+    }
+  } else {
+    if (v >= -32) {
+      writer_addbyte(w, (unsigned char)(v & 0xFF));
+    } else if (v >= INT8_MIN) {
+      writer_addheader(w, 0xD0, (uint64_t)v, 1);
+    } else if (v >= INT16_MIN) {
+      writer_addheader(w, 0xD1, (uint64_t)v, 2);
+    } else if (v >= INT32_MIN) {
+      writer_addheader(w, 0xD2, (uint64_t)v, 4);
+    } else {
+      writer_addheader(w, 0xD3, (uint64_t)v, 8);
+    }
+  }
+}
+
+static void encode_number(lua_State *L, struct msgpack_writer *w, int idx) {
+  if (lua_isinteger(L, idx)) {
+    encode_integer(w, lua_tointeger(L, idx));
+    return;
+  }
+  double d = (double)lua_tonumber(L, idx);
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  writer_addheader(w, 0xCB, bits, 8);
+}
+
+static void encode_string(lua_State *L, struct msgpack_writer *w, int idx) {
+  size_t len;
+  const char *s = lua_tolstring(L, idx, &len);
+  if (len < 32) {
+    writer_addbyte(w, (unsigned char)(0xA0 | len));
+  } else if (len <= 0xFF) {
+    writer_addheader(w, 0xD9, len, 1);
+  } else if (len <= 0xFFFF) {
+    writer_addheader(w, 0xDA, len, 2);
+  } else if ((uint64_t)len <= 0xFFFFFFFF) {
+    writer_addheader(w, 0xDB, len, 4);
+  } else {
+    luaL_error(L, "string too long for msgpack");
+  }
+  writer_addlstring(w, s, len);
+}
+
+static void encode_container_header(lua_State *L, struct msgpack_writer *w, int map, lua_Unsigned n) {
+  if (n < 16) {
+    writer_addbyte(w, (unsigned char)((map ? 0x80 : 0x90) | n));
+  } else if (n <= 0xFFFF) {
+    writer_addheader(w, map ? 0xDE : 0xDC, n, 2);
+  } else if (n <= 0xFFFFFFFF) {
+    writer_addheader(w, map ? 0xDF : 0xDD, n, 4);
+  } else {
+    luaL_error(L, "table too large for msgpack");
+  }
+}
+
+static int encodable_key(lua_State *L, int idx) {
+  switch (lua_type(L, idx)) {
+  case LUA_TBOOLEAN:
+  case LUA_TNUMBER:
+  case LUA_TSTRING:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static void encode_value(lua_State *L, struct msgpack_writer *w, int idx, int depth);
+
+static void encode_table(lua_State *L, struct msgpack_writer *w, int idx, int depth) {
+  idx = lua_absindex(L, idx);
+  if (depth >= MSGPACK_MAX_DEPTH) {
+    luaL_error(L, "table nesting too deep");
+  }
+  luaL_checkstack(L, 3, "table nesting too deep");
+  lua_Unsigned len = lua_rawlen(L, idx);
+  if (len > 0) {
+    encode_container_header(L, w, 0, len);
+    for (lua_Unsigned i = 0; i < len; ++i) {
+      lua_rawgeti(L, idx, i+1);
+      encode_value(L, w, -1, depth + 1);
+      lua_pop(L, 1);
+    }
+    return;
+  }
+  // the header needs the member count up front
+  lua_Unsigned n = 0;
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    n += encodable_key(L, -2);
+    lua_pop(L, 1);
+  }
+  encode_container_header(L, w, 1, n);
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    if (encodable_key(L, -2)) {
+      encode_value(L, w, -2, depth + 1);
+      encode_value(L, w, -1, depth + 1);
+    }
+    lua_pop(L, 1);
+  }
+}
+
+static void encode_value(lua_State *L, struct msgpack_writer *w, int idx, int depth) {
+  idx = lua_absindex(L, idx);
+  switch (lua_type(L, idx)) {
+  case LUA_TBOOLEAN:
+    writer_addbyte(w, lua_toboolean(L, idx) ? 0xC3 : 0xC2);
+    break;
+  case LUA_TNUMBER:
+    encode_number(L, w, idx);
+    break;
+  case LUA_TSTRING:
+    encode_string(L, w, idx);
+    break;
+  case LUA_TTABLE:
+    encode_table(L, w, idx, depth);
+    break;
+  default:
+    // nil and values with no msgpack form
+    writer_addbyte(w, 0xC0);
+    break;
+  }
+}
+
+static int l_encoding_msgpack_encode(lua_State *L) {
+  luaL_checkany(L, 1);
+  struct msgpack_writer w;
+  writer_init(L, &w);
+  encode_value(L, &w, 1, 0);
+  lua_pushlstring(L, w.buf, w.n);
+  return 1;
+}
+
+struct msgpack_reader {
+  const unsigned char *data;
+  const unsigned char *p;
+  const unsigned char *end;
+};
+
+static const unsigned char *reader_take(lua_State *L, struct msgpack_reader *r, size_t n) {
+  if ((size_t)(r->end - r->p) < n) {
+    luaL_error(L, "truncated msgpack data at byte %d", (int)(r->end - r->data) + 1);
+  }
+  const unsigned char *p = r->p;
+  r->p += n;
+  return p;
+}
+
+static uint64_t reader_uint(lua_State *L, struct msgpack_reader *r, int size) {
+  const unsigned char *p = reader_take(L, r, size);
+  uint64_t v = 0;
+  for (int i = 0; i < size; ++i) {
+    v = v << 8 | p[i];
+  }
+  return v;
+}
+
+static int64_t reader_int(lua_State *L, struct msgpack_reader *r, int size) {
+  uint64_t v = reader_uint(L, r, size);
+  int shift = 64 - size * 8;
+  return (int64_t)(v << shift) >> shift;
+}
+
+static void decode_value(lua_State *L, struct msgpack_reader *r, int depth);
+
+static void decode_string(lua_State *L, struct msgpack_reader *r, size_t len) {
+  const unsigned char *p = reader_take(L, r, len);
+  lua_pushlstring(L, (const char *)p, len);
+}
+
+static void decode_array(lua_State *L, struct msgpack_reader *r, uint64_t n, int depth) {
+  if (depth >= MSGPACK_MAX_DEPTH) {
+    luaL_error(L, "msgpack nesting too deep");
+  }
+  // every element takes at least one byte
+  if (n > (uint64_t)(r->end - r->p)) {
+    luaL_error(L, "truncated msgpack data at byte %d", (int)(r->end - r->data) + 1);
+  }
+  luaL_checkstack(L, 2, "msgpack nesting too deep");
+  lua_createtable(L, (int)n, 0);
+  for (uint64_t i = 1; i <= n; ++i) {
+    decode_value(L, r, depth + 1);
+    lua_rawseti(L, -2, (lua_Integer)i);
+  }
+}
+
+static void decode_map(lua_State *L, struct msgpack_reader *r, uint64_t n, int depth) {
+  if (depth >= MSGPACK_MAX_DEPTH) {
+    luaL_error(L, "msgpack nesting too deep");
+  }
+  if (n > (uint64_t)(r->end - r->p) / 2) {
+    luaL_error(L, "truncated msgpack data at byte %d", (int)(r->end - r->data) + 1);
+  }
+  luaL_checkstack(L, 3, "msgpack nesting too deep");
+  lua_createtable(L, 0, (int)n);
+  for (uint64_t i = 0; i < n; ++i) {
+    size_t at = r->p - r->data;
+    decode_value(L, r, depth + 1);
+    if (lua_isnil(L, -1) || (lua_type(L, -1) == LUA_TNUMBER && lua_tonumber(L, -1) != lua_tonumber(L, -1))) {
+      luaL_error(L, "invalid msgpack map key at byte %d", (int)at + 1);
+    }
+    decode_value(L, r, depth + 1);
+    lua_rawset(L, -3);
+  }
+}
+
+static void decode_value(lua_State *L, struct msgpack_reader *r, int depth) {
+  size_t at = r->p - r->data;
+  unsigned char c = *reader_take(L, r, 1);
+  if (c < 0x80) {
+    lua_pushinteger(L, c);
+    return;
+  } else if (c >= 0xE0) {
+    lua_pushinteger(L, (lua_Integer)(int8_t)c);
+    return;
+  } else if (c < 0x90) {
+    decode_map(L, r, c & 0x0F, depth);
+    return;
+  } else if (c < 0xA0) {
+    decode_array(L, r, c & 0x0F, depth);
+    return;
+  } else if (c < 0xC0) {
+    decode_string(L, r, c & 0x1F);
+    return;
+  }
+  switch (c) {
+  case 0xC0:
+    lua_pushnil(L);
+    break;
+  case 0xC2:
+    lua_pushboolean(L, 0);
+    break;
+  case 0xC3:
+    lua_pushboolean(L, 1);
+    break;
+  case 0xC4:
+  case 0xD9:
+    decode_string(L, r, reader_uint(L, r, 1));
+    break;
+  case 0xC5:
+  case 0xDA:
+    decode_string(L, r, reader_uint(L, r, 2));
+    break;
+  case 0xC6:
+  case 0xDB:
+    decode_string(L, r, reader_uint(L, r, 4));
+    break;
+  case 0xCA: {
+    uint32_t bits = (uint32_t)reader_uint(L, r, 4);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    lua_pushnumber(L, (lua_Number)f);
+    break;
+  }
+  case 0xCB: {
+    uint64_t bits = reader_uint(L, r, 8);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    lua_pushnumber(L, (lua_Number)d);
+    break;
+  }
+  case 0xCC:
+    lua_pushinteger(L, (lua_Integer)reader_uint(L, r, 1));
+    break;
+  case 0xCD:
+    lua_pushinteger(L, (lua_Integer)reader_uint(L, r, 2));
+    break;
+  case 0xCE:
+    lua_pushinteger(L, (lua_Integer)reader_uint(L, r, 4));
+    break;
+  case 0xCF: {
+    uint64_t v = reader_uint(L, r, 8);
+    // like JSON integers, values beyond lua_Integer become floats
+    if (v > (uint64_t)INT64_MAX) {
+      lua_pushnumber(L, (lua_Number)v);
+    } else {
+      lua_pushinteger(L, (lua_Integer)v);
+    }
+    break;
+  }
+  case 0xD0:
+    lua_pushinteger(L, (lua_Integer)reader_int(L, r, 1));
+    break;
+  case 0xD1:
+    lua_pushinteger(L, (lua_Integer)reader_int(L, r, 2));
+    break;
+  case 0xD2:
+    lua_pushinteger(L, (lua_Integer)reader_int(L, r, 4));
+    break;
+  case 0xD3:
+    lua_pushinteger(L, (lua_Integer)reader_int(L, r, 8));
+    break;
+  case 0xDC:
+    decode_array(L, r, reader_uint(L, r, 2), depth);
+    break;
+  case 0xDD:
+    decode_array(L, r, reader_uint(L, r, 4), depth);
+    break;
+  case 0xDE:
+    decode_map(L, r, reader_uint(L, r, 2), depth);
+    break;
+  case 0xDF:
+    decode_map(L, r, reader_uint(L, r, 4), depth);
+    break;
+  default:
+    // 0xC1 is never used, the rest are extension types
+    luaL_error(L, "unsupported msgpack type %d at byte %d", (int)c, (int)at + 1);
+  }
+}
+
+static int l_encoding_msgpack_decode(lua_State *L) {
+  size_t len;
+  const char *data = luaL_checklstring(L, 1, &len);
+  struct msgpack_reader r = {(const unsigned char *)data, (const unsigned char *)data, (const unsigned char *)data + len};
+  decode_value(L, &r, 0);
+  if (r.p != r.end) {
+    luaL_error(L, "trailing msgpack data at byte %d", (int)(r.p - r.data) + 1);
+  }
+  return 1;
+}
+
+static const luaL_Reg encoding_msgpack_functions[] = {
+  {"Encode", l_encoding_msgpack_encode},
+  {"Decode", l_encoding_msgpack_decode},
+  {NULL, NULL}
+};
+
+int luaopen_encoding_msgpack(lua_State *L) {
+  luaL_newlib(L, encoding_msgpack_functions);
+  return 1;
+}
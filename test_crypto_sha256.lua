@@ -9,3 +9,39 @@ print(base64.URLEncoding:Encode(hash))
 print(base64.StdEncoding:Encode(hash))
 
 print("sha256.Size", sha256.Size)
+
+local hex = require "encoding.hex"
+print(sha256.Sum("") == hash, hex.Encode(sha256.Sum("abc")))
+local sums = sha256.SumMany({"", "abc", string.rep("a", 1000)})
+print(#sums, sums[1] == hash, hex.Encode(sums[3]))
+h:Reset()
+h:Write(string.rep("a", 1000))
+print(h:Sum() == sums[3])
+print(pcall(sha256.SumMany, {"abc", true}))
+
+local batch = {}
+for i = 1, 100 do
+  batch[i] = string.rep(string.char(i), i * 13)
+end
+local batched, single = sha256.SumBatch(batch), sha256.SumMany(batch)
+local same = #batched == #single
+for i = 1, #batch do
+  same = same and batched[i] == single[i]
+end
+print(same, sha256.SumBatch({""})[1] == hash, #sha256.SumBatch({}))
+print(pcall(sha256.SumBatch, {"abc", 1}))
+
+local mac = sha256.NewHMAC("Jefe")
+local tag = mac:Sum("what do ya want for nothing?")
+print(hex.Encode(tag))
+print(mac:Sum("what do ya want for nothing?") == tag, hex.Encode(sha256.NewHMAC(string.rep("\170", 131)):Sum("Test Using Larger Than Block-Size Key - Hash Key First")))
+print(sha256.Equal(tag, mac:Sum("what do ya want for nothing?")), sha256.Equal(tag, mac:Sum("")), sha256.Equal("abc", "ab"))
+
+local prefix = sha256.New()
+prefix:Write("tenant-salt|")
+local rolling = prefix:Sum()
+local copy = prefix:Copy()
+copy:Write("body")
+prefix:Write("other")
+print(rolling == sha256.Sum("tenant-salt|"), prefix:Sum() == prefix:Sum())
+print(copy:Sum() == sha256.Sum("tenant-salt|body"), prefix:Sum() == sha256.Sum("tenant-salt|other"))
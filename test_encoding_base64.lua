@@ -33,3 +33,25 @@ print(base64.URLEncoding:Decode(base64.URLEncoding:Encode("Hello wor")))
 print(base64.URLEncoding:Decode(base64.URLEncoding:Encode("Hello worl")))
 print(base64.URLEncoding:Decode(base64.URLEncoding:Encode("Hello world")))
 print(base64.URLEncoding:Decode(base64.URLEncoding:Encode("Hello world!")))
+
+local long = string.rep("0123456789abcdefghijklmnopqrstuvwxyz\0\255", 100)
+print(base64.StdEncoding:Decode(base64.StdEncoding:Encode(long)) == long)
+print(myEncoding:Decode(myEncoding:Encode(long)) == long, #base64.URLEncoding:Encode(long))
+print(pcall(base64.StdEncoding.Decode, base64.StdEncoding, "SGVsbG8gd29y*GQh"))
+
+local encoder = base64.StdEncoding:NewEncoder()
+local parts = {encoder:Write("Hel"), encoder:Write("lo w"), encoder:Write("orld!!"), encoder:Close()}
+print(table.concat(parts))
+local decoder = base64.StdEncoding:NewDecoder({ignore_newlines = true})
+print(decoder:Write("SGVsbG8g\r\nd2"), decoder:Write("9ybGQhIQ=="), decoder:Close())
+print(pcall(decoder.Write, decoder, "SGV*"))
+
+local encoded = base64.StdEncoding:EncodeMany({"Hello", "", long})
+print(encoded[1], encoded[2], #encoded[3])
+local decoded = base64.StdEncoding:DecodeMany(encoded)
+print(decoded[1], decoded[2], decoded[3] == long)
+print(pcall(base64.StdEncoding.DecodeMany, base64.StdEncoding, {"SGk=", "S*k="}))
+local bytes = base64.NewBuffer(8)
+print(base64.StdEncoding:DecodeInto("SGVsbG8=", bytes, 2), #bytes, bytes:String(2, 6))
+print(pcall(base64.StdEncoding.DecodeInto, base64.StdEncoding, "SGVsbG8=", bytes, 5))
+print(pcall(base64.StdEncoding.DecodeInto, base64.StdEncoding, "QUFB", base64.StdEncoding:NewEncoder(), 1))
@@ -0,0 +1,18 @@
+local hex = require "encoding.hex"
+local sha256 = require "crypto.sha256"
+
+print(hex.Encode(""))
+print(hex.Encode("Hello world!"))
+print(hex.EncodeUpper("\0\1\127\128\255"))
+print(hex.Decode("48656c6c6f20776f726c6421"))
+print(hex.Decode("48656C6C6F20776F726C6421"))
+
+local h = sha256.New()
+h:Write("")
+print(hex.Encode(h:Sum()))
+
+local long = string.rep("0123456789abcdefghijklmnopqrstuvwxyz\0\255", 100)
+print(hex.Decode(hex.Encode(long)) == long, hex.Decode(hex.EncodeUpper(long)) == long, #hex.Encode(long))
+print(pcall(hex.Decode, "abc"))
+print(pcall(hex.Decode, "0g"))
+print(pcall(hex.Decode, string.rep("ab", 40) .. "zz"))
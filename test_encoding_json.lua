@@ -101,4 +101,159 @@ print(json.Stringify({[true]="123", test2=false}))
 print(json.Stringify({["test"]="123.321value", [123.321]="123.321value"}))
 print(json.Stringify({[123.321]="123.321", ["test\\2"]=false}))
 print(json.Stringify({[123.321]="123.321", ["123.321"]="2"}))
-print(json.Stringify({[1]="el1", [2]="el2", [3]="el3"}))
\ No newline at end of file
+print(json.Stringify({[1]="el1", [2]="el2", [3]="el3"}))
+obj = json.Parse(string.rep(" ", 300) .. [====[{ "quote": "a \"b\" \\", "list" : [ 1 ,	2 ,
+  3 ] }]====] .. string.rep("\n", 300))
+print("obj.quote", obj.quote, "#obj.list", #obj.list)
+
+local doc = json.Open([====[{"user": {"id": 42, "name": "Jeanette"}, "items": [{"price": 1.5}, {"price": 2}]}]====])
+print("doc.user.id", doc.user.id)
+print("doc.user.name", doc.user.name)
+print("doc.items[2].price", doc.items[2].price)
+print("#doc.items", #doc.items)
+print("doc:Get(\"/items/0/price\")", doc:Get("/items/0/price"))
+print("doc:Get(\"/missing\")", doc:Get("/missing"))
+print("doc:Get(\"/items/01/price\")", doc:Get("/items/01/price"))
+print("deep ~ pointer", json.Open(string.rep('{"~":', 2000) .. "1" .. string.rep("}", 2000)):Get(string.rep("/~0", 2000)))
+local big = json.Open('{"pad": "' .. string.rep("x", 300) .. '", "esc": "a\\"]}", "list": [[1, "]"], {"k": "\\u00e9"}, 3]}')
+print("indexed doc", big.esc, #big.list, big.list[2].k, big.list[3], big:Get("/list/0/1"))
+local list = big.list
+print("list walk", list[1][1], list[2].k, list[3], list[4], list[1][2])
+local items = {}
+for i, v in doc.items:Items() do items[#items + 1] = i .. "=" .. v.price end
+for k, v in doc.user:Items() do items[#items + 1] = k .. "=" .. tostring(v) end
+print("doc Items", table.concat(items, " "))
+print(json.Stringify(doc.user:Decode()))
+
+local dec = json.NewDecoder()
+local stream = '{"id": 1, "msg": "a \\"quoted\\" \\u0041"}\n{"id": 2, "msg": "second"}\n12345\n'
+for i = 1, #stream, 7 do
+  dec:Feed(stream:sub(i, i + 6))
+  while true do
+    local ok, v = dec:Next()
+    if not ok then
+      break
+    end
+    print("decoded", json.Stringify(v))
+  end
+end
+dec:Close()
+print("dec:Next()", dec:Next())
+
+print(json.Parse([====[1e9]====]))
+print(json.Parse([====[1E+05]====]))
+print(json.Parse([====[0.1]====]) == 0.1)
+print(json.Parse([====[9223372036854775807]====]), math.type(json.Parse([====[9223372036854775807]====])))
+print(json.Parse([====[9223372036854775808]====]), math.type(json.Parse([====[9223372036854775808]====])))
+print(json.Parse([====[-9223372036854775808]====]))
+print(json.Parse([====[123456789012345678901234567890]====]))
+print(json.Parse([====[2.2250738585072011e-308]====]))
+print(json.Parse([====[[1.5, 12345678.87654321, -0.000001]]====])[2] == 12345678.87654321)
+print(pcall(json.Parse, [====[-]====]))
+print(pcall(json.Parse, [====[1e+]====]))
+
+print(json.Stringify({0.1, 1/3, 100.0, -0.0, 1e21, 5e-324, 1.7976931348623157e308, math.maxinteger, math.mininteger}))
+print(json.Stringify({[1.5] = "x", [2^63] = "y"}))
+print(json.Parse(json.Stringify(1/3)) == 1/3)
+print(json.Parse(json.Stringify(0.1 + 0.2)) == 0.1 + 0.2)
+print(pcall(json.Stringify, 0/0))
+print(pcall(json.Stringify, math.huge))
+
+print(json.Parse([====["Aé中😀"]====]) == "Aé中😀")
+print(json.Parse([====["😀 plain run with a \"quote\" and a \\ backslash"]====]))
+print(json.Stringify("😀 " .. string.rep("long clean run ", 8) .. "\t/\"\1"))
+print(json.Parse(json.Stringify(string.rep("é中😀\n", 20))) == string.rep("é中😀\n", 20))
+print(pcall(json.Stringify, "bad \xff byte"))
+
+local snapshot = {}
+for i = 1, 100 do
+  snapshot[i] = {id = i, name = "item " .. i, tags = {"a", "b"}}
+end
+local chunks = {}
+print(json.StringifyTo(snapshot, function(chunk) chunks[#chunks + 1] = chunk end, {chunk_size = 256}))
+print(#chunks, #chunks[1], table.concat(chunks) == json.Stringify(snapshot))
+local f = io.tmpfile()
+print(json.StringifyTo(snapshot, f))
+f:seek("set")
+print(f:read("a") == json.Stringify(snapshot))
+f:close()
+print(pcall(json.StringifyTo, snapshot, f))
+
+local codec = json.Compile({
+  {"id", "integer"},
+  {"name", "string"},
+  {"score", "number"},
+  {"active", "boolean"},
+  {"meta", "any"},
+  {"owner", {{"id", "integer"}, {"email", "string"}}},
+})
+local msg = codec:Encode({id = 7, name = "widget", score = 0.5, active = true, meta = {1, 2}, owner = {id = 1, email = "a@b.c"}})
+print(msg)
+local decoded = codec:Decode(msg)
+print(decoded.id, decoded.name, decoded.score, decoded.active, decoded.meta[2], decoded.owner.email)
+decoded = codec:Decode([====[{"unknown": [1, {"x": "}"}], "name": "n", "id": 3, "score": null}]====])
+print(decoded.id, decoded.name, decoded.score)
+print(pcall(codec.Encode, codec, {id = "7"}))
+print(pcall(codec.Decode, codec, [====[{"id": 1.5}]====]))
+
+local ndjson = {}
+for i = 1, 1000 do
+  ndjson[#ndjson + 1] = json.Stringify({seq = i, msg = "line " .. i, tags = {"x", "y"}})
+end
+local blob = table.concat(ndjson, "\n") .. "\n\n"
+local values, count = json.ParseLines(blob, {threads = 4})
+print(count, values[1].seq, values[1000].msg, values[500].tags[2])
+print(select(2, json.ParseLines('{"a": 1}\r\n[true, null]\r\n"\\u00e9"')))
+print(pcall(json.ParseLines, '1\n2\n{"a": 1,}\n'))
+
+local records = {}
+for i = 1, 200 do
+  records[i] = string.format('{"id": %d, "name": "r%d", "flags": [true, false], "geo": {"lat": 1.5, "lon": -2.5}}', i, i)
+end
+local parsed = json.Parse("[" .. table.concat(records, ",") .. "]")
+print(#parsed, parsed[200].id, parsed[200].name, parsed[200].geo.lon, #parsed[17].flags)
+local keyed = json.NewDecoder()
+keyed:Feed(table.concat(records, "\n", 1, 3))
+keyed:Close()
+while true do
+  local ok, v = keyed:Next()
+  if not ok then
+    break
+  end
+  print("decoded", v.id, v.name, v.geo.lat)
+end
+local target = {}
+json.ParseInto('{"a": 1, "b": {"c": 2, "d": [1, 2, 3]}, "s": "x"}', target)
+local inner, list = target.b, target.b.d
+json.ParseInto('{"b": {"c": 5, "d": [9]}, "e": null}', target)
+print(target.a, target.s, target.e, target.b == inner, target.b.d == list, target.b.c, #list, list[1])
+print(pcall(json.ParseInto, "1", {}))
+local event = '{"user": {"id": 7, "tags": ["a", {"b": [1, 2]}]}, "event": {"type": "click"}, "a/b": 1}'
+print(json.Extract(event, {"/user/id", "/event/type", "/missing", "/user/tags/1/b/1", "/a~1b"}))
+print(json.Extract('{"a": 1, "rest": [1, 2, 3] not looked at', {"/a"}))
+print(json.Extract('{"a": 1, "a": 2, "l": [5, 6]}', {"/a", "/l/00", "/l/01", "/l/1"}))
+local fixture = os.tmpname()
+local f = io.open(fixture, "w")
+f:write('{"name": "fixture", "sizes": [1, 2, 3]}\n')
+f:close()
+local loaded = json.ParseFile(fixture)
+print(loaded.name, #loaded.sizes, pcall(json.ParseFile, fixture .. ".missing"))
+os.remove(fixture)
+print(pcall(json.Parse, '[1] \0 [2]'))
+local payload = {zeta = 1, alpha = {b = {3, {y = 1, x = 2}}}, [5] = true, A = "s"}
+print(json.Stringify(payload, {canonical = true}))
+print(pcall(json.Stringify, {[true] = 1, ["true"] = 2}, {canonical = true}))
+local sha256 = require "crypto.sha256"
+local streamed, whole = sha256.New(), sha256.New()
+print(json.HashCanonical(payload, streamed, {chunk_size = 64}))
+whole:Write(json.Stringify(payload, {canonical = true}))
+print(streamed:Sum() == whole:Sum())
+local metrics = json.Parse('{"ints": [1, 2, 3], "floats": [1.5, -2, 1e3], "mixed": [1, "x"]}', {numeric_arrays = "typed"})
+print(type(metrics.ints), #metrics.ints, metrics.ints[3], metrics.floats[2], metrics.ints[4], type(metrics.mixed))
+metrics.ints[1] = 10
+print(json.Stringify(metrics.ints), json.Stringify(metrics.floats))
+local base64 = require "encoding.base64"
+local blob = json.Parse('{"payload": "SGVsbG8gd29ybGQh", "sig": "-_8=", "note": "SGk="}', {base64_fields = {"payload", sig = base64.URLEncoding}})
+print(blob.payload, #blob.sig, blob.note)
+print(json.Stringify({payload = "Hello world!"}, {base64_fields = {"payload"}}))
+print(pcall(json.Parse, '{"payload": "SG=k"}', {base64_fields = {"payload"}}))
@@ -0,0 +1,27 @@
+local msgpack = require "encoding.msgpack"
+
+local function hex(s)
+  return (s:gsub(".", function(c) return string.format("%02x", c:byte()) end))
+end
+
+print(hex(msgpack.Encode(1)))
+print(hex(msgpack.Encode(-33)))
+print(hex(msgpack.Encode(65536)))
+print(hex(msgpack.Encode(1.5)))
+print(hex(msgpack.Encode("test")))
+print(hex(msgpack.Encode({1, 2, 3})))
+print(hex(msgpack.Encode({})))
+print(hex(msgpack.Encode({test = true})))
+
+local obj = msgpack.Decode(msgpack.Encode({id = 7, name = "widget", tags = {"a", "b"}, price = 0.1, nested = {ok = false}}))
+print(obj.id, math.type(obj.id), obj.name, obj.tags[2], obj.price == 0.1, obj.nested.ok)
+print(msgpack.Decode(msgpack.Encode(math.maxinteger)) == math.maxinteger)
+print(msgpack.Decode(msgpack.Encode(math.mininteger)) == math.mininteger)
+print(msgpack.Decode(msgpack.Encode(string.rep("x", 70000))) == string.rep("x", 70000))
+
+local keys = msgpack.Decode(msgpack.Encode({[true] = "t", [2.5] = "f", [10] = "ten"}))
+print(keys[true], keys[2.5], keys[10])
+
+print(pcall(msgpack.Decode, "\x92\x01"))
+print(pcall(msgpack.Decode, "\xc1"))
+print(pcall(msgpack.Decode, "\x01\x02"))